@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "apu_thread.h"
 #include "gba.h"
 #include "io.h"
 #include "scheduler.h"
@@ -10,7 +11,9 @@
 byte duty_cycles[] = {0b11111110, 0b01111110, 0b01111000, 0b10000001};
 
 void apu_enable(APU* apu) {
-    add_event(&apu->master->sched, EVENT_APU_SAMPLE, apu->master->sched.now + SAMPLE_PERIOD);
+    if (!apu->silent) {
+        add_event(&apu->master->sched, EVENT_APU_SAMPLE, apu->master->sched.now + SAMPLE_PERIOD);
+    }
     add_event(&apu->master->sched, EVENT_APU_DIV_TICK, apu->master->sched.now + APU_DIV_PERIOD);
 }
 
@@ -25,6 +28,26 @@ void apu_disable(APU* apu) {
     remove_event(&apu->master->sched, EVENT_APU_DIV_TICK);
 }
 
+void apu_set_silent(APU* apu, bool silent) {
+    if (apu->silent == silent) return;
+    apu->silent = silent;
+    if (!(apu->master->io.nr52 & (1 << 7))) return;
+
+    // ch3 keeps reloading since it swaps the cpu visible waveram bank
+    if (silent) {
+        apu_update_status(apu);
+        remove_event(&apu->master->sched, EVENT_APU_SAMPLE);
+        remove_event(&apu->master->sched, EVENT_APU_CH1_REL);
+        remove_event(&apu->master->sched, EVENT_APU_CH2_REL);
+        remove_event(&apu->master->sched, EVENT_APU_CH4_REL);
+    } else {
+        add_event(&apu->master->sched, EVENT_APU_SAMPLE, apu->master->sched.now + SAMPLE_PERIOD);
+        if (apu->ch1_enable) ch1_reload(apu);
+        if (apu->ch2_enable) ch2_reload(apu);
+        if (apu->ch4_enable) ch4_reload(apu);
+    }
+}
+
 static inline shword get_sample_ch1(APU* apu) {
     return (duty_cycles[(apu->master->io.nr11 & NRX1_DUTY) >> 6] & (1 << (apu->ch1_duty_index & 7)))
                ? apu->ch1_volume
@@ -62,10 +85,14 @@ static inline shword get_sample_ch4(APU* apu) {
     return (apu->ch4_lfsr & 1) ? apu->ch4_volume : -apu->ch4_volume;
 }
 
-void apu_new_sample(APU* apu) {
+void apu_update_status(APU* apu) {
     apu->master->io.nr52 = 0b10000000 | (apu->ch1_enable ? 0b0001 : 0) |
                            (apu->ch2_enable ? 0b0010 : 0) | (apu->ch3_enable ? 0b0100 : 0) |
                            (apu->ch4_enable ? 0b1000 : 0);
+}
+
+void apu_new_sample(APU* apu) {
+    apu_update_status(apu);
 
     shword ch1_sample = apu->ch1_enable ? get_sample_ch1(apu) : 0;
     shword ch2_sample = apu->ch2_enable ? get_sample_ch2(apu) : 0;
@@ -87,8 +114,8 @@ void apu_new_sample(APU* apu) {
     l_sample >>= 2 - apu->master->io.soundcnth.gb_volume;
     r_sample >>= 2 - apu->master->io.soundcnth.gb_volume;
 
-    shword cha_sample = apu->fifo_a[0] * 2;
-    shword chb_sample = apu->fifo_b[0] * 2;
+    shword cha_sample = apu->fifo_a[apu->fifo_a_head & (FIFO_LEN - 1)] * 2;
+    shword chb_sample = apu->fifo_b[apu->fifo_b_head & (FIFO_LEN - 1)] * 2;
     if (apu->master->io.soundcnth.cha_volume) cha_sample *= 2;
     if (apu->master->io.soundcnth.chb_volume) chb_sample *= 2;
     if (apu->master->io.soundcnth.cha_ena_left) l_sample += cha_sample;
@@ -115,12 +142,14 @@ void apu_new_sample(APU* apu) {
 }
 
 void ch1_reload(APU* apu) {
+    if (apu->silent) return;
     apu->ch1_duty_index++;
     dword next_rel = (2048 - apu->ch1_wavelen) * 16;
     add_event(&apu->master->sched, EVENT_APU_CH1_REL, apu->master->sched.now + next_rel);
 }
 
 void ch2_reload(APU* apu) {
+    if (apu->silent) return;
     apu->ch2_duty_index++;
     dword next_rel = (2048 - apu->ch2_wavelen) * 16;
     add_event(&apu->master->sched, EVENT_APU_CH2_REL, apu->master->sched.now + next_rel);
@@ -136,6 +165,7 @@ void ch3_reload(APU* apu) {
 }
 
 void ch4_reload(APU* apu) {
+    if (apu->silent) return;
     hword bit = (~(apu->ch4_lfsr ^ (apu->ch4_lfsr >> 1))) & 1;
     apu->ch4_lfsr = (apu->ch4_lfsr & ~(1 << 15)) | (bit << 15);
     if (apu->master->io.nr43 & NR43_WIDTH) {
@@ -256,32 +286,37 @@ void waveram_swap(APU* apu) {
     memcpy(apu->master->io.waveram, tmp, sizeof tmp);
 }
 
+// the fifos are ring buffers indexed by free running head/tail counters,
+// the front sample stays in place when the fifo runs dry
+
 void fifo_a_push(APU* apu, word samples) {
+    if (apu->deferred) apu_thread_log(apu->master, APU_LOG_FIFO_A_PUSH, 0, samples);
     for (int i = 0; i < 4; i++, samples >>= 8) {
-        if (apu->fifo_a_size == 32) fifo_a_pop(apu);
-        apu->fifo_a[apu->fifo_a_size++] = samples & 0xff;
+        apu->fifo_a[apu->fifo_a_tail++ & (FIFO_LEN - 1)] = samples & 0xff;
+    }
+    if ((byte) (apu->fifo_a_tail - apu->fifo_a_head) > FIFO_LEN) {
+        apu->fifo_a_head = apu->fifo_a_tail - FIFO_LEN;
     }
 }
 
-void fifo_a_pop(APU* apu) {
-    if (apu->fifo_a_size <= 1) return;
-    apu->fifo_a_size--;
-    for (int i = 0; i < apu->fifo_a_size; i++) {
-        apu->fifo_a[i] = apu->fifo_a[i + 1];
-    }
+bool fifo_a_pop(APU* apu) {
+    if (apu->deferred) apu_thread_log(apu->master, APU_LOG_FIFO_A_POP, 0, 0);
+    if ((byte) (apu->fifo_a_tail - apu->fifo_a_head) > 1) apu->fifo_a_head++;
+    return (byte) (apu->fifo_a_tail - apu->fifo_a_head) <= FIFO_LEN / 2;
 }
 
 void fifo_b_push(APU* apu, word samples) {
+    if (apu->deferred) apu_thread_log(apu->master, APU_LOG_FIFO_B_PUSH, 0, samples);
     for (int i = 0; i < 4; i++, samples >>= 8) {
-        if (apu->fifo_b_size == 32) fifo_b_pop(apu);
-        apu->fifo_b[apu->fifo_b_size++] = samples & 0xff;
+        apu->fifo_b[apu->fifo_b_tail++ & (FIFO_LEN - 1)] = samples & 0xff;
+    }
+    if ((byte) (apu->fifo_b_tail - apu->fifo_b_head) > FIFO_LEN) {
+        apu->fifo_b_head = apu->fifo_b_tail - FIFO_LEN;
     }
 }
 
-void fifo_b_pop(APU* apu) {
-    if (apu->fifo_b_size <= 1) return;
-    apu->fifo_b_size--;
-    for (int i = 0; i < apu->fifo_b_size; i++) {
-        apu->fifo_b[i] = apu->fifo_b[i + 1];
-    }
+bool fifo_b_pop(APU* apu) {
+    if (apu->deferred) apu_thread_log(apu->master, APU_LOG_FIFO_B_POP, 0, 0);
+    if ((byte) (apu->fifo_b_tail - apu->fifo_b_head) > 1) apu->fifo_b_head++;
+    return (byte) (apu->fifo_b_tail - apu->fifo_b_head) <= FIFO_LEN / 2;
 }
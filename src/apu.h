@@ -9,6 +9,8 @@
 #define SAMPLE_PERIOD ((1 << 24) / SAMPLE_FREQ)
 #define SAMPLE_BUF_LEN 1024
 
+#define FIFO_LEN 32
+
 enum { NRX1_LEN = 0b00111111, NRX1_DUTY = 0b11000000 };
 
 enum { NRX2_PACE = 0b00000111, NRX2_DIR = 1 << 3, NRX2_VOL = 0b11110000 };
@@ -32,6 +34,11 @@ typedef struct {
     int sample_ind;
     bool samples_full;
 
+    // skip psg synthesis and mixing, the fifos and sound dma keep running
+    bool silent;
+    // log synthesis state changes for the apu thread
+    bool deferred;
+
     bool ch1_enable;
     hword ch1_wavelen;
     byte ch1_duty_index;
@@ -66,16 +73,21 @@ typedef struct {
     byte ch4_volume;
     byte ch4_len_counter;
 
-    sbyte fifo_a[32];
-    sbyte fifo_b[32];
+    sbyte fifo_a[FIFO_LEN];
+    sbyte fifo_b[FIFO_LEN];
 
-    byte fifo_a_size;
-    byte fifo_b_size;
+    byte fifo_a_head;
+    byte fifo_a_tail;
+    byte fifo_b_head;
+    byte fifo_b_tail;
 } APU;
 
 void apu_enable(APU* apu);
 void apu_disable(APU* apu);
 
+void apu_set_silent(APU* apu, bool silent);
+
+void apu_update_status(APU* apu);
 void apu_new_sample(APU* apu);
 
 void ch1_reload(APU* apu);
@@ -86,10 +98,10 @@ void ch4_reload(APU* apu);
 void waveram_swap(APU* apu);
 
 void fifo_a_push(APU* apu, word samples);
-void fifo_a_pop(APU* apu);
+bool fifo_a_pop(APU* apu);
 
 void fifo_b_push(APU* apu, word samples);
-void fifo_b_pop(APU* apu);
+bool fifo_b_pop(APU* apu);
 
 void apu_div_tick(APU* apu);
 
@@ -0,0 +1,186 @@
+#include "apu_thread.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apu.h"
+#include "gba.h"
+#include "io.h"
+#include "scheduler.h"
+
+// the emulation thread runs its apu silent and logs every write that
+// affects synthesis, the worker replays the log on a shadow gba which
+// only has its io, apu and scheduler in use. a savestate load reseeds
+// the shadow from the loaded state but keeps the queued samples
+
+pthread_t apu_worker;
+pthread_mutex_t apu_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t apu_cond = PTHREAD_COND_INITIALIZER;
+bool apu_running;
+bool apu_quit;
+bool apu_pending;
+
+GBA* shadow;
+
+ApuLogEntry apu_log[2][APU_LOG_LEN];
+int apu_log_len[2];
+int apu_log_cur;
+dword apu_log_end;
+
+float apu_out[APU_OUT_BLOCKS][SAMPLE_BUF_LEN];
+int apu_out_head;
+int apu_out_tail;
+
+static void push_block(float* buf) {
+    pthread_mutex_lock(&apu_lock);
+    memcpy(apu_out[apu_out_tail++ % APU_OUT_BLOCKS], buf, sizeof apu_out[0]);
+    if (apu_out_tail - apu_out_head > APU_OUT_BLOCKS) apu_out_head++;
+    pthread_mutex_unlock(&apu_lock);
+}
+
+// fifo pops happen inside timer events, which usually precede an output
+// sample on the same cycle, so those only run events strictly before
+static void run_until(dword time, bool inclusive) {
+    Scheduler* sched = &shadow->sched;
+    while (sched->n_events && sched->event_queue[0].time + !inclusive <= time) {
+        run_next_event(sched);
+        if (shadow->apu.samples_full) {
+            push_block(shadow->apu.sample_buf);
+            shadow->apu.samples_full = false;
+        }
+    }
+    sched->now = time;
+}
+
+static void replay(ApuLogEntry* log, int len, dword end) {
+    for (int i = 0; i < len; i++) {
+        run_until(log[i].time, log[i].type < APU_LOG_FIFO_A_POP);
+        switch (log[i].type) {
+            case APU_LOG_WRITE:
+                io_writeh(&shadow->io, log[i].addr, log[i].data);
+                break;
+            case APU_LOG_FIFO_A_PUSH:
+                fifo_a_push(&shadow->apu, log[i].data);
+                break;
+            case APU_LOG_FIFO_B_PUSH:
+                fifo_b_push(&shadow->apu, log[i].data);
+                break;
+            case APU_LOG_FIFO_A_POP:
+                fifo_a_pop(&shadow->apu);
+                break;
+            case APU_LOG_FIFO_B_POP:
+                fifo_b_pop(&shadow->apu);
+                break;
+        }
+    }
+    run_until(end, true);
+}
+
+static void* apu_worker_run(void* arg) {
+    pthread_mutex_lock(&apu_lock);
+    while (true) {
+        while (!apu_pending && !apu_quit) pthread_cond_wait(&apu_cond, &apu_lock);
+        if (apu_quit) break;
+        int b = apu_log_cur ^ 1;
+        dword end = apu_log_end;
+        pthread_mutex_unlock(&apu_lock);
+
+        replay(apu_log[b], apu_log_len[b], end);
+
+        pthread_mutex_lock(&apu_lock);
+        apu_pending = false;
+        pthread_cond_broadcast(&apu_cond);
+    }
+    pthread_mutex_unlock(&apu_lock);
+    return NULL;
+}
+
+// the caller holds apu_lock with the worker idle
+static void seed_shadow(GBA* gba) {
+    shadow->io = gba->io;
+    shadow->apu = gba->apu;
+    shadow->sched.now = gba->sched.now;
+    shadow->sched.n_events = 0;
+    for (int i = 0; i < gba->sched.n_events; i++) {
+        if (gba->sched.event_queue[i].type >= EVENT_APU_SAMPLE) {
+            shadow->sched.event_queue[shadow->sched.n_events++] = gba->sched.event_queue[i];
+        }
+    }
+    gba_set_ptrs(shadow, NULL, NULL);
+    shadow->apu.deferred = false;
+    apu_set_silent(&shadow->apu, false);
+
+    apu_log_len[apu_log_cur] = 0;
+}
+
+void apu_thread_start(GBA* gba) {
+    if (!shadow) shadow = calloc(1, sizeof *shadow);
+    if (!apu_running) {
+        apu_running = true;
+        pthread_create(&apu_worker, NULL, apu_worker_run, NULL);
+    }
+
+    pthread_mutex_lock(&apu_lock);
+    while (apu_pending) pthread_cond_wait(&apu_cond, &apu_lock);
+    seed_shadow(gba);
+    apu_out_head = apu_out_tail = 0;
+    pthread_mutex_unlock(&apu_lock);
+
+    gba->apu.deferred = true;
+    apu_set_silent(&gba->apu, true);
+}
+
+// drops the unplayed log and restarts the shadow from the current state,
+// after a savestate load or a frame whose audio nobody hears
+void apu_thread_reseed(GBA* gba) {
+    if (!apu_running) return;
+
+    pthread_mutex_lock(&apu_lock);
+    while (apu_pending) pthread_cond_wait(&apu_cond, &apu_lock);
+    seed_shadow(gba);
+    pthread_mutex_unlock(&apu_lock);
+}
+
+void apu_thread_stop(GBA* gba) {
+    gba->apu.deferred = false;
+    if (!apu_running) return;
+
+    pthread_mutex_lock(&apu_lock);
+    apu_quit = true;
+    pthread_cond_broadcast(&apu_cond);
+    pthread_mutex_unlock(&apu_lock);
+    pthread_join(apu_worker, NULL);
+
+    apu_running = false;
+    apu_quit = false;
+    apu_pending = false;
+}
+
+void apu_thread_log(GBA* gba, ApuLogType type, hword addr, word data) {
+    if (!apu_running) return;
+    if (apu_log_len[apu_log_cur] == APU_LOG_LEN) apu_thread_sync(gba);
+    apu_log[apu_log_cur][apu_log_len[apu_log_cur]++] =
+        (ApuLogEntry){.time = gba->sched.now, .data = data, .addr = addr, .type = type};
+}
+
+void apu_thread_sync(GBA* gba) {
+    if (!apu_running) return;
+
+    pthread_mutex_lock(&apu_lock);
+    while (apu_pending) pthread_cond_wait(&apu_cond, &apu_lock);
+    apu_log_end = gba->sched.now;
+    apu_log_cur ^= 1;
+    apu_log_len[apu_log_cur] = 0;
+    apu_pending = true;
+    pthread_cond_broadcast(&apu_cond);
+    pthread_mutex_unlock(&apu_lock);
+}
+
+bool apu_thread_samples(float* buf) {
+    pthread_mutex_lock(&apu_lock);
+    bool avail = apu_out_head != apu_out_tail;
+    if (avail) memcpy(buf, apu_out[apu_out_head++ % APU_OUT_BLOCKS], sizeof apu_out[0]);
+    pthread_mutex_unlock(&apu_lock);
+    return avail;
+}
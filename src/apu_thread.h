@@ -0,0 +1,35 @@
+#ifndef APU_THREAD_H
+#define APU_THREAD_H
+
+#include "types.h"
+
+#define APU_LOG_LEN 0x4000
+#define APU_OUT_BLOCKS 8
+
+typedef enum {
+    APU_LOG_WRITE,
+    APU_LOG_FIFO_A_PUSH,
+    APU_LOG_FIFO_B_PUSH,
+    APU_LOG_FIFO_A_POP,
+    APU_LOG_FIFO_B_POP
+} ApuLogType;
+
+typedef struct {
+    dword time;
+    word data;
+    hword addr;
+    byte type;
+} ApuLogEntry;
+
+typedef struct _GBA GBA;
+
+void apu_thread_start(GBA* gba);
+void apu_thread_stop(GBA* gba);
+void apu_thread_reseed(GBA* gba);
+
+void apu_thread_log(GBA* gba, ApuLogType type, hword addr, word data);
+void apu_thread_sync(GBA* gba);
+
+bool apu_thread_samples(float* buf);
+
+#endif
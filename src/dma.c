@@ -1,8 +1,10 @@
 #include "dma.h"
 
 #include "gba.h"
+#include "ppu_thread.h"
 
 #include <stdio.h>
+#include <string.h>
 
 void dma_enable(DMAController* dmac, int i) {
     dmac->dma[i].sptr = dmac->master->io.dma[i].sad;
@@ -85,27 +87,64 @@ void update_addr(word* addr, int adcnt, int wsize) {
     }
 }
 
+static int max_waitstates(GBA* gba, word addr) {
+    word region = addr >> 24;
+    if (region < 8) {
+        if (region == R_EWRAM) return 6;
+        if (region == R_PRAM || region == R_VRAM) return 2;
+        return 1;
+    } else if (region < 16) {
+        int i = (region >> 1) & 0b11;
+        if (i == 3) return gba->cart_n_waits[3];
+        int n_waits = gba->cart_n_waits[i];
+        int s_waits = gba->cart_s_waits[i];
+        return 1 + (n_waits > s_waits ? n_waits : s_waits) + s_waits;
+    } else return 1;
+}
+
+// a sound refill can be done in one step when nothing else can happen
+// while it runs: no waiting dma would interleave and no event is due
+// before the transfer is over
+bool dma_fifo_batchable(DMAController* dmac, int i) {
+    for (int j = 0; j < i; j++) {
+        if (dmac->dma[j].waiting) return false;
+    }
+    if (!dmac->master->sched.n_events) return true;
+    int max_cycles = dmac->dma[i].ct * (max_waitstates(dmac->master, dmac->dma[i].sptr) +
+                                        max_waitstates(dmac->master, dmac->dma[i].dptr));
+    return dmac->master->sched.event_queue[0].time > dmac->master->sched.now + max_cycles;
+}
+
 void dma_run(DMAController* dmac, int i) {
     if (dmac->master->bus_locks || i > dmac->active_dma) {
         dmac->dma[i].waiting = true;
         return;
     }
+    PROF_ENTER(PROF_DMA);
 
     dmac->dma[i].initial = true;
-    do {
+    if (dmac->dma[i].sound && dma_fifo_batchable(dmac, i)) {
         dmac->active_dma = i;
-        if (dmac->master->io.dma[i].cnt.wsize || dmac->dma[i].sound) {
-            dma_transw(dmac, i, dmac->dma[i].dptr, dmac->dma[i].sptr);
-        } else {
-            dma_transh(dmac, i, dmac->dma[i].dptr, dmac->dma[i].sptr);
-        }
-        update_addr(&dmac->dma[i].sptr, dmac->master->io.dma[i].cnt.sadcnt,
-                    2 << dmac->master->io.dma[i].cnt.wsize);
-        if (!dmac->dma[i].sound)
-            update_addr(&dmac->dma[i].dptr, dmac->master->io.dma[i].cnt.dadcnt,
+        dma_trans_fifo(dmac, i);
+    } else {
+        int units;
+        do {
+            dmac->active_dma = i;
+            if (!dmac->dma[i].sound && (units = dma_trans_bulk(dmac, i))) continue;
+            units = 1;
+            if (dmac->master->io.dma[i].cnt.wsize || dmac->dma[i].sound) {
+                dma_transw(dmac, i, dmac->dma[i].dptr, dmac->dma[i].sptr);
+            } else {
+                dma_transh(dmac, i, dmac->dma[i].dptr, dmac->dma[i].sptr);
+            }
+            update_addr(&dmac->dma[i].sptr, dmac->master->io.dma[i].cnt.sadcnt,
                         2 << dmac->master->io.dma[i].cnt.wsize);
-        dmac->dma[i].initial = false;
-    } while (--dmac->dma[i].ct > 0);
+            if (!dmac->dma[i].sound)
+                update_addr(&dmac->dma[i].dptr, dmac->master->io.dma[i].cnt.dadcnt,
+                            2 << dmac->master->io.dma[i].cnt.wsize);
+            dmac->dma[i].initial = false;
+        } while ((dmac->dma[i].ct -= units) > 0);
+    }
     dmac->master->prefetch_halted = false;
 
     dmac->dma[i].sound = false;
@@ -118,6 +157,7 @@ void dma_run(DMAController* dmac, int i) {
     if (dmac->master->io.dma[i].cnt.irq) dmac->master->io.ifl.dma |= (1 << i);
 
     bus_unlock(dmac->master, 4);
+    PROF_LEAVE();
 }
 
 void dma_transh(DMAController* dmac, int i, word daddr, word saddr) {
@@ -158,3 +198,195 @@ void dma_transw(DMAController* dmac, int i, word daddr, word saddr) {
     bus_writew(dmac->master, daddr, data);
     bus_unlock(dmac->master, i);
 }
+
+void dma_trans_fifo(DMAController* dmac, int i) {
+    bus_lock(dmac->master);
+    int cycles = 0;
+    for (; dmac->dma[i].ct > 0; dmac->dma[i].ct--) {
+        word saddr = dmac->dma[i].sptr;
+        word daddr = dmac->dma[i].dptr;
+        cycles += get_waitstates(dmac->master, saddr, true, !dmac->dma[i].initial);
+        word data = bus_readw(dmac->master, saddr);
+        if (dmac->master->openbus || saddr < BIOS_SIZE) data = dmac->dma[i].bus_val;
+        else dmac->dma[i].bus_val = data;
+        dmac->master->cpu.bus_val = data;
+        dmac->master->prefetch_halted = true;
+        cycles += get_waitstates(dmac->master, daddr, true,
+                                 !dmac->dma[i].initial || (saddr & 1 << 27));
+        bus_writew(dmac->master, daddr, data);
+        update_addr(&dmac->dma[i].sptr, dmac->master->io.dma[i].cnt.sadcnt,
+                    2 << dmac->master->io.dma[i].cnt.wsize);
+        dmac->dma[i].initial = false;
+    }
+    tick_components(dmac->master, cycles, true);
+    bus_unlock(dmac->master, i);
+}
+
+// the host memory at addr, if every address from lo up to hi lies in
+// the same mirror of a region and below limit in it
+static byte* dma_window(byte* mem, word mirror, word limit, word addr, word lo, word hi) {
+    if (lo % mirror + (hi - lo) > limit) return NULL;
+    return mem + addr % mirror;
+}
+
+// the host memory a transfer walks through with step from addr, or NULL
+// unless it stays in plain memory without wrapping. rom is only read
+static byte* dma_host_mem(GBA* gba, word addr, int step, int units, int size, bool dst) {
+    word lo = addr, hi = addr + size;
+    if (step > 0) hi = addr + units * size;
+    if (step < 0) lo = addr - (units - 1) * size;
+    word region = addr >> 24;
+    if (lo >> 24 != region || (hi - 1) >> 24 != region) return NULL;
+
+    switch (region) {
+        case R_EWRAM:
+            return dma_window(gba->ewram.b, EWRAM_SIZE, EWRAM_SIZE, addr, lo, hi);
+        case R_IWRAM:
+            return dma_window(gba->iwram.b, IWRAM_SIZE, IWRAM_SIZE, addr, lo, hi);
+        case R_PRAM:
+            return dma_window(gba->pram.b, PRAM_SIZE, PRAM_SIZE, addr, lo, hi);
+        case R_VRAM:
+            return dma_window(gba->vram.b, 0x20000, VRAM_SIZE, addr, lo, hi);
+        case R_OAM:
+            return dma_window(gba->oam.b, OAM_SIZE, OAM_SIZE, addr, lo, hi);
+        case R_ROM0:
+        case R_ROM0EX:
+        case R_ROM1:
+        case R_ROM1EX:
+        case R_ROM2:
+        case R_ROM2EX: {
+            if (dst) return NULL;
+            word limit = gba->cart->rom_size;
+            if (gba->cart->eeprom_mask && gba->cart->eeprom_mask < limit) {
+                limit = gba->cart->eeprom_mask;
+            }
+            return dma_window(gba->cart->rom.b, 1 << 25, limit, addr, lo, hi);
+        }
+        default:
+            return NULL;
+    }
+}
+
+static int dma_step(int adcnt, int size) {
+    switch (adcnt) {
+        case DMA_ADCNT_DEC:
+            return -size;
+        case DMA_ADCNT_FIX:
+            return 0;
+        default:
+            return size;
+    }
+}
+
+// the cycles the units after the first take: the prefetcher is halted by
+// then, so each access is a sequential one except for rom accesses that
+// start a new 128k block
+static int dma_seq_cycles(GBA* gba, word addr, int step, int units, bool w) {
+    word region = addr >> 24;
+    if (region < 8) return (units - 1) * get_waitstates(gba, addr, w, true);
+    int i = (region >> 1) & 0b11;
+    int n_waits = gba->cart_n_waits[i];
+    int s_waits = gba->cart_s_waits[i];
+    word last = addr + (units - 1) * step;
+    int blocks = last / 0x20000 - addr / 0x20000;
+    return (units - 1) * (w ? 2 * s_waits : s_waits) + blocks * (n_waits - s_waits);
+}
+
+// runs as many units as are sure to end before the next event in one go,
+// copying through host memory and ticking the total of their waitstates.
+// nothing can happen in between, so this is the same as running them one
+// by one. the first unit of a transfer always runs on its own, it can
+// still wait on the prefetcher. returns the units it ran, 0 if an end is
+// not plain memory or the next unit has to run on its own
+int dma_trans_bulk(DMAController* dmac, int i) {
+    GBA* gba = dmac->master;
+    if (dmac->dma[i].initial) return 0;
+    for (int j = 0; j < i; j++) {
+        if (dmac->dma[j].waiting) return 0;
+    }
+    bool w = gba->io.dma[i].cnt.wsize;
+    int size = w ? 4 : 2;
+    int units = dmac->dma[i].ct;
+    word saddr = dmac->dma[i].sptr;
+    word daddr = dmac->dma[i].dptr;
+    if (gba->sched.n_events) {
+        int max_unit = max_waitstates(gba, saddr) + max_waitstates(gba, daddr);
+        sdword room = gba->sched.event_queue[0].time - gba->sched.now - 1;
+        if (room < (sdword) units * max_unit) units = room < 0 ? 0 : room / max_unit;
+        if (!units) return 0;
+    }
+    int sstep = saddr >> 24 >= R_ROM0 ? size : dma_step(gba->io.dma[i].cnt.sadcnt, size);
+    int dstep = dma_step(gba->io.dma[i].cnt.dadcnt, size);
+
+    byte* src = dma_host_mem(gba, saddr, sstep, units, size, false);
+    byte* dst = dma_host_mem(gba, daddr, dstep, units, size, true);
+    if (!src || !dst) return 0;
+
+    bus_lock(gba);
+
+    // the first unit is charged as usual, it may start a new rom block
+    int cycles = get_waitstates(gba, saddr, w, true);
+    cycles += get_waitstates(gba, daddr, w, true);
+    cycles += dma_seq_cycles(gba, saddr, sstep, units, w);
+    cycles += dma_seq_cycles(gba, daddr, dstep, units, w);
+
+    word dregion = daddr >> 24;
+    bool ppu_mem = dregion == R_PRAM || dregion == R_VRAM || dregion == R_OAM;
+    if (ppu_mem) ppu_catch_up(&gba->ppu);
+
+    // a forward copy that doesn't overlap itself is one memcpy
+    int len = units * size;
+    bool changed = false;
+    word data = 0;
+    if (sstep == size && dstep == size && (src + len <= dst || dst + len <= src)) {
+        changed = memcmp(dst, src, len);
+        memcpy(dst, src, len);
+        memcpy(&data, src + len - size, size);
+    } else {
+        for (int k = 0; k < units; k++, src += sstep, dst += dstep) {
+            memcpy(&data, src, size);
+            if (memcmp(dst, &data, size)) {
+                changed = true;
+                memcpy(dst, &data, size);
+            }
+        }
+    }
+
+    if (ppu_mem) {
+        word off = dstep < 0 ? daddr - len + size : daddr;
+        if (!dstep) len = size;
+        word mem = PPU_MEM_OAM;
+        if (dregion == R_PRAM) {
+            off %= PRAM_SIZE;
+            mem = PPU_MEM_PRAM;
+            if (changed) gba->ppu.mem_gen[GEN_PRAM]++;
+        } else if (dregion == R_VRAM) {
+            off %= 0x20000;
+            mem = PPU_MEM_VRAM;
+            if (changed && off < 0x10000) gba->ppu.mem_gen[GEN_VRAM_BG]++;
+            if (changed && off + len > 0x10000) gba->ppu.mem_gen[GEN_VRAM_OBJ]++;
+            ppu_tiles_dirty(gba, off, len);
+        } else {
+            off %= OAM_SIZE;
+            if (changed) gba->ppu.mem_gen[GEN_OAM]++;
+            ppu_objs_dirty(gba, off, len);
+        }
+        if (gba->ppu.threaded) {
+            for (word a = mem + off; a < mem + off + len; a += PPU_CHUNK_SIZE) {
+                ppu_thread_dirty(a);
+            }
+            ppu_thread_dirty(mem + off + len - 1);
+        }
+    }
+
+    if (!w) data = (hword) data * 0x00010001;
+    dmac->dma[i].bus_val = data;
+    gba->cpu.bus_val = data;
+    dmac->dma[i].sptr = saddr + units * sstep;
+    dmac->dma[i].dptr = daddr + units * dstep;
+    dmac->dma[i].initial = false;
+
+    tick_components(gba, cycles, true);
+    bus_unlock(gba, i);
+    return units;
+}
@@ -31,4 +31,8 @@ void dma_run(DMAController* dmac, int i);
 void dma_transh(DMAController* dmac, int i, word daddr, word saddr);
 void dma_transw(DMAController* dmac, int i, word daddr, word saddr);
 
+bool dma_fifo_batchable(DMAController* dmac, int i);
+void dma_trans_fifo(DMAController* dmac, int i);
+int dma_trans_bulk(DMAController* dmac, int i);
+
 #endif
\ No newline at end of file
@@ -1,9 +1,14 @@
 #include "emulator.h"
 
-#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
+#include "apu_thread.h"
 #include "arm_isa.h"
+#include "ppu_replay.h"
+#include "ppu_thread.h"
 #include "gba.h"
 #include "thumb_isa.h"
 
@@ -13,9 +18,18 @@ const char usage[] = "agbemu [options] <romfile>\n"
                      "-b <biosfile> -- specify bios file path\n"
                      "-f -- apply color filter\n"
                      "-u -- run at uncapped speed\n"
+                     "-v -- sync to vsync with dynamic audio rate control\n"
+                     "-l <ms> -- target audio latency (default 40)\n"
+                     "-s -- disable sound synthesis\n"
+                     "-a -- synthesize sound on a separate thread\n"
+                     "-t -- render on a separate thread\n"
+                     "-k <n|auto> -- skip n frames per frame drawn, or skip while running late\n"
+                     "-n -- don't draw video\n"
+                     "-p <file> -- capture the ppu input of the first frames for ppubench\n"
                      "-d -- run the debugger\n";
 
 int emulator_init(int argc, char** argv) {
+    agbemu.audio_latency = 40;
     read_args(argc, argv);
     if (!agbemu.romfile) {
         printf(usage);
@@ -41,10 +55,18 @@ int emulator_init(int argc, char** argv) {
         return -1;
     }
 
+    // lines are only captured where they are drawn in order
+    if (agbemu.capturefile) agbemu.render_thread = false;
+
     arm_generate_lookup();
     thumb_generate_lookup();
-    init_color_lookups();
     init_gba(agbemu.gba, agbemu.cart, agbemu.bios, agbemu.bootbios);
+    init_audio();
+    init_video();
+
+    if (agbemu.capturefile && !replay_capture_start(agbemu.capturefile, CAPTURE_FRAMES)) {
+        printf("Could not open capture file\n");
+    }
 
     agbemu.romfilenodir = strrchr(agbemu.romfile, '/');
     if (agbemu.romfilenodir) agbemu.romfilenodir++;
@@ -53,6 +75,9 @@ int emulator_init(int argc, char** argv) {
 }
 
 void emulator_quit() {
+    apu_thread_stop(agbemu.gba);
+    ppu_thread_stop(agbemu.gba);
+    replay_capture_stop();
     destroy_cartridge(agbemu.cart);
     free(agbemu.bios);
     free(agbemu.gba);
@@ -78,6 +103,39 @@ void read_args(int argc, char** argv) {
                     case 'd':
                         agbemu.debugger = true;
                         break;
+                    case 'a':
+                        agbemu.audio_thread = true;
+                        break;
+                    case 't':
+                        agbemu.render_thread = true;
+                        break;
+                    case 's':
+                        agbemu.silent = true;
+                        break;
+                    case 'v':
+                        agbemu.vsync = true;
+                        break;
+                    case 'k':
+                        if (!*(f + 1) && i + 1 < argc) {
+                            i++;
+                            agbemu.frameskip =
+                                strcmp(argv[i], "auto") ? atoi(argv[i]) : FRAMESKIP_AUTO;
+                        }
+                        break;
+                    case 'n':
+                        agbemu.video_off = true;
+                        break;
+                    case 'p':
+                        if (!*(f + 1) && i + 1 < argc) {
+                            agbemu.capturefile = argv[++i];
+                        }
+                        break;
+                    case 'l':
+                        if (!*(f + 1) && i + 1 < argc) {
+                            int latency = atoi(argv[++i]);
+                            if (latency > 0) agbemu.audio_latency = latency;
+                        }
+                        break;
                     default:
                         printf("Invalid flag\n");
                 }
@@ -88,11 +146,42 @@ void read_args(int argc, char** argv) {
     }
 }
 
+void init_audio() {
+    if (agbemu.audio_thread && !agbemu.silent) {
+        apu_thread_start(agbemu.gba);
+    } else {
+        apu_thread_stop(agbemu.gba);
+        apu_set_silent(&agbemu.gba->apu, agbemu.silent);
+    }
+}
+
+void init_video() {
+    ppu_set_pixfmt(agbemu.pixfmt, agbemu.filter);
+    if (agbemu.render_thread) {
+        ppu_thread_start(agbemu.gba);
+    } else {
+        ppu_thread_stop(agbemu.gba);
+    }
+}
+
+// decides whether the ppu draws the next frame. a fixed frameskip draws
+// one frame out of every frameskip + 1, auto skips while the previous
+// frame ran late but still draws at least every FRAMESKIP_AUTO_MAX + 1
+bool skip_next_frame(bool late) {
+    static int skipped;
+    if (agbemu.video_off) return true;
+    bool skip = false;
+    if (agbemu.frameskip > 0) skip = skipped < agbemu.frameskip;
+    if (agbemu.frameskip == FRAMESKIP_AUTO) skip = late && skipped < FRAMESKIP_AUTO_MAX;
+    skipped = skip ? skipped + 1 : 0;
+    return skip;
+}
+
 void save_state() {
     gba_clear_ptrs(agbemu.gba);
 
     gzFile fp = gzopen(agbemu.cart->sst_filename, "wb");
-    gzfwrite(agbemu.gba, sizeof *agbemu.gba, 1, fp);
+    gzfwrite(agbemu.gba, GBA_STATE_SIZE, 1, fp);
     gzfwrite(&agbemu.cart->st, sizeof agbemu.cart->st, 1, fp);
     gzclose(fp);
 
@@ -103,102 +192,11 @@ void load_state() {
     gba_clear_ptrs(agbemu.gba);
 
     gzFile fp = gzopen(agbemu.cart->sst_filename, "rb");
-    gzfread(agbemu.gba, sizeof *agbemu.gba, 1, fp);
+    gzfread(agbemu.gba, GBA_STATE_SIZE, 1, fp);
     gzfread(&agbemu.cart->st, sizeof agbemu.cart->st, 1, fp);
     gzclose(fp);
 
     gba_set_ptrs(agbemu.gba, agbemu.cart, agbemu.bios);
+    init_audio();
+    init_video();
 }
-
-void hotkey_press(SDL_KeyCode key) {
-    switch (key) {
-        case SDLK_p:
-            agbemu.pause = !agbemu.pause;
-            break;
-        case SDLK_m:
-            agbemu.mute = !agbemu.mute;
-            break;
-        case SDLK_f:
-            agbemu.filter = !agbemu.filter;
-            break;
-        case SDLK_r:
-            init_gba(agbemu.gba, agbemu.cart, agbemu.bios, agbemu.bootbios);
-            agbemu.pause = false;
-            break;
-        case SDLK_TAB:
-            agbemu.uncap = !agbemu.uncap;
-            break;
-        case SDLK_9:
-            save_state();
-            break;
-        case SDLK_0:
-            load_state();
-            break;
-        default:
-            break;
-    }
-}
-
-void update_input_keyboard(GBA* gba) {
-    const Uint8* keys = SDL_GetKeyboardState(NULL);
-    gba->io.keyinput.a = ~keys[SDL_SCANCODE_Z];
-    gba->io.keyinput.b = ~keys[SDL_SCANCODE_X];
-    gba->io.keyinput.start = ~keys[SDL_SCANCODE_RETURN];
-    gba->io.keyinput.select = ~keys[SDL_SCANCODE_RSHIFT];
-    gba->io.keyinput.left = ~keys[SDL_SCANCODE_LEFT];
-    gba->io.keyinput.right = ~keys[SDL_SCANCODE_RIGHT];
-    gba->io.keyinput.up = ~keys[SDL_SCANCODE_UP];
-    gba->io.keyinput.down = ~keys[SDL_SCANCODE_DOWN];
-    gba->io.keyinput.l = ~keys[SDL_SCANCODE_A];
-    gba->io.keyinput.r = ~keys[SDL_SCANCODE_S];
-}
-
-void update_input_controller(GBA* gba, SDL_GameController* controller) {
-    gba->io.keyinput.a &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_A);
-    gba->io.keyinput.b &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_X);
-    gba->io.keyinput.start &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_START);
-    gba->io.keyinput.select &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_BACK);
-    gba->io.keyinput.left &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_DPAD_LEFT);
-    gba->io.keyinput.right &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_DPAD_RIGHT);
-    gba->io.keyinput.up &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_UP);
-    gba->io.keyinput.down &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_DPAD_DOWN);
-    gba->io.keyinput.l &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_LEFTSHOULDER);
-    gba->io.keyinput.r &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);
-}
-
-byte color_lookup[32];
-byte color_lookup_filter[32];
-
-void init_color_lookups() {
-    for (int i = 0; i < 32; i++) {
-        float c = (float) i / 31;
-        color_lookup[i] = c * 255;
-        color_lookup_filter[i] = pow(c, 1.7) * 255;
-    }
-}
-
-void gba_convert_screen(hword* gba_screen, Uint32* screen) {
-    for (int i = 0; i < GBA_SCREEN_W * GBA_SCREEN_H; i++) {
-        int r = gba_screen[i] & 0x1f;
-        int g = (gba_screen[i] >> 5) & 0x1f;
-        int b = (gba_screen[i] >> 10) & 0x1f;
-        if (agbemu.filter) {
-            screen[i] = color_lookup_filter[r] << 16 |
-                        color_lookup_filter[g] << 8 |
-                        color_lookup_filter[b] << 0;
-        } else {
-            screen[i] = color_lookup[r] << 16 | color_lookup[g] << 8 |
-                        color_lookup[b] << 0;
-        }
-    }
-}
\ No newline at end of file
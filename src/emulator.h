@@ -1,22 +1,34 @@
 #ifndef EMULATOR_H
 #define EMULATOR_H
 
-#include <SDL2/SDL.h>
-
 #include "gba.h"
 #include "types.h"
 
+#define FRAMESKIP_AUTO -1
+#define FRAMESKIP_AUTO_MAX 4
+
+#define CAPTURE_FRAMES 60
+
 typedef struct {
     bool running;
     char* romfile;
     char* romfilenodir;
     char* biosfile;
+    char* capturefile;
     bool uncap;
     bool bootbios;
     bool filter;
+    int pixfmt;
     bool pause;
     bool mute;
     bool debugger;
+    bool silent;
+    bool audio_thread;
+    bool render_thread;
+    bool vsync;
+    int frameskip;
+    bool video_off;
+    int audio_latency;
 
     GBA* gba;
     Cartridge* cart;
@@ -30,10 +42,10 @@ int emulator_init(int argc, char** argv);
 void emulator_quit();
 
 void read_args(int argc, char** argv);
-void hotkey_press(SDL_KeyCode key);
-void update_input_keyboard(GBA* gba);
-void update_input_controller(GBA* gba, SDL_GameController* controller);
-void init_color_lookups();
-void gba_convert_screen(hword* gba_screen, Uint32* screen);
+void init_audio();
+void init_video();
+bool skip_next_frame(bool late);
+void save_state();
+void load_state();
 
 #endif
\ No newline at end of file
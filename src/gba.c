@@ -9,6 +9,7 @@
 #include "dma.h"
 #include "io.h"
 #include "ppu.h"
+#include "ppu_thread.h"
 #include "scheduler.h"
 #include "timer.h"
 #include "types.h"
@@ -27,7 +28,7 @@ void gba_clear_ptrs(GBA* gba) {
     gba->bios.b = NULL;
 }
 
-void gba_set_ptrs(GBA* gba, Cartridge* cart, byte* bios) {
+static void set_ptrs(GBA* gba, Cartridge* cart, byte* bios) {
     gba->cart = cart;
     gba->cpu.master = gba;
     gba->ppu.master = gba;
@@ -39,6 +40,23 @@ void gba_set_ptrs(GBA* gba, Cartridge* cart, byte* bios) {
     gba->bios.b = bios;
 }
 
+// the state may have been replaced, so the ppu caches go. runahead and
+// rewind loads cost a frame drawn in full
+void gba_set_ptrs(GBA* gba, Cartridge* cart, byte* bios) {
+    set_ptrs(gba, cart, bios);
+    ppu_invalidate_caches(gba);
+}
+
+// copies out the savestate part with the pointers cleared, leaving the
+// caches alone since nothing was replaced
+void gba_serialize(GBA* gba, void* buf) {
+    Cartridge* cart = gba->cart;
+    byte* bios = gba->bios.b;
+    gba_clear_ptrs(gba);
+    memcpy(buf, gba, GBA_STATE_SIZE);
+    set_ptrs(gba, cart, bios);
+}
+
 void init_gba(GBA* gba, Cartridge* cart, byte* bios, bool bootbios) {
     memset(gba, 0, sizeof *gba);
     memset(&cart->st, 0, sizeof cart->st);
@@ -84,6 +102,30 @@ byte* load_bios(char* filename) {
     return bios;
 }
 
+static dword fnv(dword h, const void* data, size_t len) {
+    const byte* b = data;
+    for (size_t i = 0; i < len; i++) h = (h ^ b[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+// fnv-1a hashes for telling runs apart across builds. the tools print and
+// compare these, so they have to agree on them
+dword gba_hash_screen(GBA* gba) {
+    return fnv(0xcbf29ce484222325ULL, gba->ppu_cache.screen, sizeof gba->ppu_cache.screen);
+}
+
+dword gba_hash_state(GBA* gba) {
+    dword h = 0xcbf29ce484222325ULL;
+    h = fnv(h, gba->cpu.r, sizeof gba->cpu.r);
+    h = fnv(h, gba->io.b, sizeof gba->io.b);
+    h = fnv(h, gba->ewram.b, sizeof gba->ewram.b);
+    h = fnv(h, gba->iwram.b, sizeof gba->iwram.b);
+    h = fnv(h, gba->pram.b, sizeof gba->pram.b);
+    h = fnv(h, gba->vram.b, sizeof gba->vram.b);
+    h = fnv(h, gba->oam.b, sizeof gba->oam.b);
+    return fnv(h, &gba->sched.now, sizeof gba->sched.now);
+}
+
 void update_cart_waits(GBA* gba) {
     gba->cart_n_waits[0] = CART_WAITS[gba->io.waitcnt.rom0];
     gba->cart_n_waits[1] = CART_WAITS[gba->io.waitcnt.rom1];
@@ -389,18 +431,31 @@ void bus_writeb(GBA* gba, word addr, byte b) {
             break;
         case R_IO:
             if (addr < IO_SIZE) {
+                if (addr < SOUND1CNT_L && gba->io.b[addr] != b) ppu_catch_up(&gba->ppu);
                 io_writeb(&gba->io, addr, b);
             }
             break;
         case R_PRAM:
+            if (gba->pram.h[addr % PRAM_SIZE >> 1] != b * 0x0101) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[GEN_PRAM]++;
+            }
             gba->pram.h[addr % PRAM_SIZE >> 1] = b * 0x0101;
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_PRAM + addr % PRAM_SIZE);
             break;
         case R_VRAM:
             addr %= 0x20000;
             if (addr >= VRAM_SIZE) addr -= 0x8000;
             if (addr < 0x10000 ||
-                (addr < 0x14000 && gba->io.dispcnt.bg_mode >= 3))
+                (addr < 0x14000 && gba->io.dispcnt.bg_mode >= 3)) {
+                if (gba->vram.h[addr >> 1] != b * 0x0101) {
+                    ppu_catch_up(&gba->ppu);
+                    gba->ppu.mem_gen[addr < 0x10000 ? GEN_VRAM_BG : GEN_VRAM_OBJ]++;
+                }
                 gba->vram.h[addr >> 1] = b * 0x0101;
+                ppu_tiles_dirty(gba, addr, 2);
+                if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_VRAM + addr);
+            }
             break;
         case R_OAM:
             break;
@@ -439,19 +494,37 @@ void bus_writeh(GBA* gba, word addr, hword h) {
             break;
         case R_IO:
             if (addr < IO_SIZE) {
+                if (addr < SOUND1CNT_L && gba->io.h[addr >> 1] != h) ppu_catch_up(&gba->ppu);
                 io_writeh(&gba->io, addr & ~1, h);
             }
             break;
         case R_PRAM:
+            if (gba->pram.h[addr % PRAM_SIZE >> 1] != h) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[GEN_PRAM]++;
+            }
             gba->pram.h[addr % PRAM_SIZE >> 1] = h;
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_PRAM + addr % PRAM_SIZE);
             break;
         case R_VRAM:
             addr %= 0x20000;
             if (addr >= VRAM_SIZE) addr -= 0x8000;
+            if (gba->vram.h[addr >> 1] != h) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[addr < 0x10000 ? GEN_VRAM_BG : GEN_VRAM_OBJ]++;
+            }
             gba->vram.h[addr >> 1] = h;
+            ppu_tiles_dirty(gba, addr, 2);
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_VRAM + addr);
             break;
         case R_OAM:
+            if (gba->oam.h[addr % OAM_SIZE >> 1] != h) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[GEN_OAM]++;
+            }
             gba->oam.h[addr % OAM_SIZE >> 1] = h;
+            ppu_objs_dirty(gba, addr % OAM_SIZE, 2);
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_OAM + addr % OAM_SIZE);
             break;
         case R_ROM0:
         case R_ROM0EX:
@@ -488,19 +561,37 @@ void bus_writew(GBA* gba, word addr, word w) {
             break;
         case R_IO:
             if (addr < IO_SIZE) {
+                if (addr < SOUND1CNT_L && gba->io.w[addr >> 2] != w) ppu_catch_up(&gba->ppu);
                 io_writew(&gba->io, addr & ~0b11, w);
             }
             break;
         case R_PRAM:
+            if (gba->pram.w[addr % PRAM_SIZE >> 2] != w) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[GEN_PRAM]++;
+            }
             gba->pram.w[addr % PRAM_SIZE >> 2] = w;
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_PRAM + addr % PRAM_SIZE);
             break;
         case R_VRAM:
             addr %= 0x20000;
             if (addr >= VRAM_SIZE) addr -= 0x8000;
+            if (gba->vram.w[addr >> 2] != w) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[addr < 0x10000 ? GEN_VRAM_BG : GEN_VRAM_OBJ]++;
+            }
             gba->vram.w[addr >> 2] = w;
+            ppu_tiles_dirty(gba, addr, 4);
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_VRAM + addr);
             break;
         case R_OAM:
+            if (gba->oam.w[addr % OAM_SIZE >> 2] != w) {
+                ppu_catch_up(&gba->ppu);
+                gba->ppu.mem_gen[GEN_OAM]++;
+            }
             gba->oam.w[addr % OAM_SIZE >> 2] = w;
+            ppu_objs_dirty(gba, addr % OAM_SIZE, 4);
+            if (gba->ppu.threaded) ppu_thread_dirty(PPU_MEM_OAM + addr % OAM_SIZE);
             break;
         case R_ROM0:
         case R_ROM0EX:
@@ -103,15 +103,23 @@ typedef struct _GBA {
     int bus_locks;
     bool openbus;
 
+    // not part of savestates, everything above is
+    PpuCache ppu_cache;
 } GBA;
 
+#define GBA_STATE_SIZE offsetof(GBA, ppu_cache)
+
 void gba_clear_ptrs(GBA* gba);
 void gba_set_ptrs(GBA* gba, Cartridge* cart, byte* bios);
+void gba_serialize(GBA* gba, void* buf);
 
 void init_gba(GBA* gba, Cartridge* cart, byte* bios, bool bootbios);
 
 byte* load_bios(char* filename);
 
+dword gba_hash_screen(GBA* gba);
+dword gba_hash_state(GBA* gba);
+
 void update_cart_waits(GBA* gba);
 
 int get_waitstates(GBA* gba, word addr, bool w, bool seq);
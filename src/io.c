@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 
+#include "apu_thread.h"
 #include "dma.h"
 #include "gba.h"
 
@@ -84,6 +85,12 @@ hword io_readh(IO* io, word addr) {
         case SOUND2CNT_H:
         case SOUND3CNT_X:
             return io->h[addr >> 1] & ~NRX34_WVLEN;
+        case SOUNDCNT_X:
+            // nr52 is otherwise only refreshed on each output sample
+            if (io->master->apu.silent && (io->nr52 & (1 << 7))) {
+                apu_update_status(&io->master->apu);
+            }
+            break;
         case TM0CNT_L:
         case TM1CNT_L:
         case TM2CNT_L:
@@ -104,6 +111,9 @@ void io_writeh(IO* io, word addr, hword data) {
         io_writew(io, addr & ~0b11, io->w[addr >> 2]);
         return;
     }
+    if (io->master->apu.deferred && SOUND1CNT_L <= addr && addr < FIFO_A) {
+        apu_thread_log(io->master, APU_LOG_WRITE, addr, data);
+    }
     switch (addr) {
         case DISPSTAT:
             io->dispstat.h &= 0b111;
@@ -253,11 +263,11 @@ void io_writeh(IO* io, word addr, hword data) {
             io->soundcnth.h = data;
             if (io->soundcnth.cha_reset) {
                 io->soundcnth.cha_reset = 0;
-                io->master->apu.fifo_a_size = 0;
+                io->master->apu.fifo_a_tail = io->master->apu.fifo_a_head;
             }
             if (io->soundcnth.chb_reset) {
                 io->soundcnth.chb_reset = 0;
-                io->master->apu.fifo_b_size = 0;
+                io->master->apu.fifo_b_tail = io->master->apu.fifo_b_head;
             }
             io->soundcnth.unused = 0;
             break;
@@ -8,6 +8,8 @@
 #include "libretro.h"
 
 #include "emulator.h"
+#include "apu_thread.h"
+#include "ppu_thread.h"
 #include "gba.h"
 #include "arm_isa.h"
 #include "thumb_isa.h"
@@ -25,6 +27,10 @@ static retro_input_state_t input_state_cb;
 static struct retro_log_callback logging;
 static retro_log_printf_t log_cb;
 
+static bool can_dupe;
+static enum retro_pixel_format pixel_format;
+static bool audio_underrun_likely;
+
 static char* system_path;
 static char* saves_path;
 
@@ -205,17 +211,51 @@ static void init_config()
     { "agbemu_boot_bios", "Boot bios on startup; enabled|disabled" },
     { "agbemu_uncaped_speed", "Run at uncapped speed; enabled|disabled" },
     { "agbemu_color_filter", "Apply color filter; disabled|enabled" },
+    { "agbemu_pixel_format", "Pixel format (restart); xrgb8888|rgb565" },
+    { "agbemu_audio", "Emulate audio; enabled|disabled" },
+    { "agbemu_audio_thread", "Synthesize audio on a separate thread; disabled|enabled" },
+    { "agbemu_render_thread", "Render on a separate thread; disabled|enabled" },
+    { "agbemu_frameskip", "Frameskip; disabled|auto|1|2|3|4" },
     { NULL, NULL }
   };
 
   environ_cb(RETRO_ENVIRONMENT_SET_VARIABLES, (void*)values);
 }
 
+static void audio_buffer_status(bool active, unsigned occupancy, bool underrun_likely)
+{
+  audio_underrun_likely = active && underrun_likely;
+}
+
+// the frontend only takes a pixel format while loading, so a change to
+// the option applies on the next restart
+static void init_pixel_format()
+{
+  char* value = fetch_variable("agbemu_pixel_format", "xrgb8888");
+  pixel_format = strcmp(value, "rgb565") == 0 ? RETRO_PIXEL_FORMAT_RGB565
+                                               : RETRO_PIXEL_FORMAT_XRGB8888;
+  free(value);
+
+  if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format))
+  {
+    pixel_format = RETRO_PIXEL_FORMAT_XRGB8888;
+    environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &pixel_format);
+  }
+}
+
 static void update_config()
 {
   agbemu.bootbios = fetch_variable_bool("agbemu_boot_bios", true);
   agbemu.uncap = fetch_variable_bool("agbemu_uncaped_speed", true);
   agbemu.filter = fetch_variable_bool("agbemu_color_filter", false);
+  agbemu.pixfmt = pixel_format == RETRO_PIXEL_FORMAT_RGB565 ? PIXFMT_RGB565 : PIXFMT_XRGB8888;
+  agbemu.silent = !fetch_variable_bool("agbemu_audio", true);
+  agbemu.audio_thread = fetch_variable_bool("agbemu_audio_thread", false);
+  agbemu.render_thread = fetch_variable_bool("agbemu_render_thread", false);
+
+  char* frameskip = fetch_variable("agbemu_frameskip", "disabled");
+  agbemu.frameskip = strcmp(frameskip, "auto") == 0 ? FRAMESKIP_AUTO : atoi(frameskip);
+  free(frameskip);
 }
 
 static void check_config_variables()
@@ -223,7 +263,16 @@ static void check_config_variables()
   bool updated = false;
   environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated);
 
-  if (updated) update_config();
+  if (updated)
+  {
+    bool silent = agbemu.silent;
+    bool audio_thread = agbemu.audio_thread;
+    update_config();
+    // restarting the audio thread would throw its queued samples away
+    if (agbemu.silent != silent || agbemu.audio_thread != audio_thread)
+      init_audio();
+    init_video();
+  }
 }
 
 void retro_get_system_info(struct retro_system_info* info)
@@ -279,8 +328,8 @@ void retro_set_input_state(retro_input_state_t cb)
 
 void retro_init(void)
 {
-  enum retro_pixel_format xrgb888 = RETRO_PIXEL_FORMAT_XRGB8888;
-  environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &xrgb888);
+  if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &can_dupe))
+    can_dupe = false;
 
   if (environ_cb(RETRO_ENVIRONMENT_GET_LOG_INTERFACE, &logging))
     log_cb = logging.log;
@@ -306,6 +355,10 @@ bool retro_load_game(const struct retro_game_info* info)
 
   init_config();
   init_input();
+  init_pixel_format();
+
+  struct retro_audio_buffer_status_callback buf_status = { audio_buffer_status };
+  environ_cb(RETRO_ENVIRONMENT_SET_AUDIO_BUFFER_STATUS_CALLBACK, &buf_status);
 
   update_config();
 
@@ -337,10 +390,10 @@ bool retro_load_game(const struct retro_game_info* info)
   arm_generate_lookup();
   thumb_generate_lookup();
 
-  init_color_lookups();
-
   load_save_file(agbemu.cart, save_path);
   init_gba(agbemu.gba, agbemu.cart, agbemu.bios, agbemu.bootbios);
+  init_audio();
+  init_video();
 
   agbemu.running = true;
   agbemu.debugger = false;
@@ -355,6 +408,8 @@ bool retro_load_game_special(unsigned type, const struct retro_game_info* info,
 
 void retro_unload_game(void)
 {
+  apu_thread_stop(agbemu.gba);
+  ppu_thread_stop(agbemu.gba);
   destroy_cartridge(agbemu.cart);
   free(agbemu.bios);
   free(agbemu.gba);
@@ -364,6 +419,8 @@ void retro_reset(void)
 {
   gba_clear_ptrs(agbemu.gba);
   init_gba(agbemu.gba, agbemu.cart, agbemu.bios, agbemu.bootbios);
+  init_audio();
+  init_video();
 }
 
 void retro_run(void)
@@ -382,9 +439,35 @@ void retro_run(void)
   agbemu.gba->io.keyinput.l = ~(int)get_button_state(RETRO_DEVICE_ID_JOYPAD_L);
   agbemu.gba->io.keyinput.r = ~(int)get_button_state(RETRO_DEVICE_ID_JOYPAD_R);
 
-  static uint32_t pixels[GBA_SCREEN_W * GBA_SCREEN_H];
   static int16_t samples[SAMPLE_BUF_LEN];
 
+  // frames the frontend throws away, like runahead, are never drawn. a
+  // skipped frame is presented as a dupe, so frameskip needs dupe support
+  int av_enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+  if (!environ_cb(RETRO_ENVIRONMENT_GET_AUDIO_VIDEO_ENABLE, &av_enable))
+    av_enable = RETRO_AV_ENABLE_VIDEO | RETRO_AV_ENABLE_AUDIO;
+
+  bool skip = can_dupe && skip_next_frame(audio_underrun_likely);
+  agbemu.gba->ppu.skip_frame = skip || !(av_enable & RETRO_AV_ENABLE_VIDEO);
+
+  // draw straight into the frontend's framebuffer when it lends one that
+  // matches, otherwise into the ppu screen which gets handed over
+  struct retro_framebuffer fb = {0};
+  fb.width = GBA_SCREEN_W;
+  fb.height = GBA_SCREEN_H;
+  fb.access_flags = RETRO_MEMORY_ACCESS_WRITE;
+
+  if (!agbemu.gba->ppu.skip_frame)
+  {
+    if (environ_cb(RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER, &fb) && fb.data &&
+        fb.format == pixel_format && fb.width == GBA_SCREEN_W && fb.height == GBA_SCREEN_H)
+      ppu_set_output(fb.data, fb.pitch);
+    else
+      ppu_set_output(NULL, 0);
+  }
+
+  dword lines_drawn = ppu_stats.lines_drawn;
+
   while (!agbemu.gba->stop && !agbemu.gba->ppu.frame_complete)
   {
     gba_step(agbemu.gba);
@@ -399,10 +482,33 @@ void retro_run(void)
     }
   }
 
-  gba_convert_screen((hword*)agbemu.gba->ppu.screen, pixels);
+  // frames without audio, like the hidden runahead ones, are never
+  // synthesized, the shadow just moves on to where the frame ended
+  if (agbemu.gba->apu.deferred && !(av_enable & RETRO_AV_ENABLE_AUDIO))
+    apu_thread_reseed(agbemu.gba);
+  else if (agbemu.gba->apu.deferred)
+  {
+    static float sample_buf[SAMPLE_BUF_LEN];
+
+    apu_thread_sync(agbemu.gba);
+    while (apu_thread_samples(sample_buf))
+      for (size_t i = 0; i < SAMPLE_BUF_LEN; i++)
+        samples[i] = (int16_t)(sample_buf[i] * 32767.0f);
+  }
+
   agbemu.gba->ppu.frame_complete = false;
 
-  video_cb(pixels, GBA_SCREEN_W, GBA_SCREEN_H, GBA_SCREEN_W * 4);
+  // every line reused means the last frame is still what is on screen
+  if (agbemu.gba->ppu.skip_frame || (can_dupe && ppu_stats.lines_drawn == lines_drawn))
+    video_cb(NULL, GBA_SCREEN_W, GBA_SCREEN_H, 0);
+  else if (host_out)
+    video_cb(host_out, GBA_SCREEN_W, GBA_SCREEN_H, fb.pitch);
+  else
+    video_cb(agbemu.gba->ppu_cache.screen, GBA_SCREEN_W, GBA_SCREEN_H,
+             sizeof agbemu.gba->ppu_cache.screen[0]);
+
+  // with the audio thread on the apu is silent but the samples are real
+  if (agbemu.silent) memset(samples, 0, sizeof(samples));
   audio_batch_cb(samples, sizeof(samples) / (2 * sizeof(int16_t)));
 }
 
@@ -412,28 +518,35 @@ void retro_set_controller_port_device(unsigned port, unsigned device)
 
 size_t retro_serialize_size(void)
 {
-  return sizeof(*agbemu.gba) + sizeof(agbemu.cart->st);
+  return GBA_STATE_SIZE + sizeof(agbemu.cart->st);
 }
 
 bool retro_serialize(void* data, size_t size)
 {
-  gba_clear_ptrs(agbemu.gba);
-
-  memcpy(data, agbemu.gba, sizeof(*agbemu.gba));
-  memcpy((char*)data + sizeof(*agbemu.gba), &agbemu.cart->st, sizeof(agbemu.cart->st));
-
-  gba_set_ptrs(agbemu.gba, agbemu.cart, agbemu.bios);
+  gba_serialize(agbemu.gba, data);
+  memcpy((char*)data + GBA_STATE_SIZE, &agbemu.cart->st, sizeof(agbemu.cart->st));
   return true;
 }
 
 bool retro_unserialize(const void* data, size_t size)
 {
+  bool deferred = agbemu.gba->apu.deferred;
+  bool silent = agbemu.gba->apu.silent;
+
   gba_clear_ptrs(agbemu.gba);
 
-  memcpy(agbemu.gba, data, sizeof(*agbemu.gba));
-  memcpy(&agbemu.cart->st, (const char*)data + sizeof(*agbemu.gba), sizeof(agbemu.cart->st));
+  memcpy(agbemu.gba, data, GBA_STATE_SIZE);
+  memcpy(&agbemu.cart->st, (const char*)data + GBA_STATE_SIZE, sizeof(agbemu.cart->st));
 
   gba_set_ptrs(agbemu.gba, agbemu.cart, agbemu.bios);
+  // runahead and rewind load a state every frame, the audio thread only
+  // restarts when the state was saved with other audio options, else it
+  // keeps its queued samples and goes on from the loaded registers
+  if (agbemu.gba->apu.deferred != deferred || agbemu.gba->apu.silent != silent)
+    init_audio();
+  else
+    apu_thread_reseed(agbemu.gba);
+  init_video();
   return true;
 }
 
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 
 #include "apu.h"
+#include "apu_thread.h"
 #include "arm_isa.h"
 #include "cartridge.h"
 #include "debugger.h"
@@ -28,6 +29,121 @@ static inline void center_screen_in_window(int windowW, int windowH, SDL_Rect* d
     }
 }
 
+// max fraction the audio resampling ratio is skewed by to keep the
+// queued audio at the latency target
+#define DRC_MAX_DELTA 0.005
+
+float drc_buf[2 * SAMPLE_BUF_LEN];
+float drc_prev[2];
+double drc_pos;
+
+// linear resampling of one stereo sample block, ratio is the number
+// of output samples produced per input sample
+int drc_resample(float* in, int in_len, float* out, int out_max, double ratio) {
+    double step = 1 / ratio;
+    int out_len = 0;
+    while (drc_pos < in_len - 1 && out_len < out_max) {
+        int i = (int) (drc_pos + 1) - 1;
+        float t = drc_pos - i;
+        for (int c = 0; c < 2; c++) {
+            float a = (i < 0) ? drc_prev[c] : in[2 * i + c];
+            float b = in[2 * (i + 1) + c];
+            out[2 * out_len + c] = a + (b - a) * t;
+        }
+        out_len++;
+        drc_pos += step;
+    }
+    drc_pos -= in_len;
+    drc_prev[0] = in[2 * (in_len - 1)];
+    drc_prev[1] = in[2 * (in_len - 1) + 1];
+    return out_len;
+}
+
+void hotkey_press(SDL_KeyCode key) {
+    switch (key) {
+        case SDLK_p:
+            agbemu.pause = !agbemu.pause;
+            break;
+        case SDLK_m:
+            agbemu.mute = !agbemu.mute;
+            break;
+        case SDLK_f:
+            agbemu.filter = !agbemu.filter;
+            ppu_set_pixfmt(agbemu.pixfmt, agbemu.filter);
+            break;
+        case SDLK_r:
+            init_gba(agbemu.gba, agbemu.cart, agbemu.bios, agbemu.bootbios);
+            init_audio();
+            init_video();
+            agbemu.pause = false;
+            break;
+        case SDLK_TAB:
+            agbemu.uncap = !agbemu.uncap;
+            break;
+        case SDLK_9:
+            save_state();
+            break;
+        case SDLK_0:
+            load_state();
+            break;
+        default:
+            break;
+    }
+}
+
+void update_input_keyboard(GBA* gba) {
+    const Uint8* keys = SDL_GetKeyboardState(NULL);
+    gba->io.keyinput.a = ~keys[SDL_SCANCODE_Z];
+    gba->io.keyinput.b = ~keys[SDL_SCANCODE_X];
+    gba->io.keyinput.start = ~keys[SDL_SCANCODE_RETURN];
+    gba->io.keyinput.select = ~keys[SDL_SCANCODE_RSHIFT];
+    gba->io.keyinput.left = ~keys[SDL_SCANCODE_LEFT];
+    gba->io.keyinput.right = ~keys[SDL_SCANCODE_RIGHT];
+    gba->io.keyinput.up = ~keys[SDL_SCANCODE_UP];
+    gba->io.keyinput.down = ~keys[SDL_SCANCODE_DOWN];
+    gba->io.keyinput.l = ~keys[SDL_SCANCODE_A];
+    gba->io.keyinput.r = ~keys[SDL_SCANCODE_S];
+}
+
+void update_input_controller(GBA* gba, SDL_GameController* controller) {
+    gba->io.keyinput.a &=
+        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_A);
+    gba->io.keyinput.b &=
+        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_X);
+    gba->io.keyinput.start &=
+        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_START);
+    gba->io.keyinput.select &=
+        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_BACK);
+    gba->io.keyinput.left &= ~SDL_GameControllerGetButton(
+        controller, SDL_CONTROLLER_BUTTON_DPAD_LEFT);
+    gba->io.keyinput.right &= ~SDL_GameControllerGetButton(
+        controller, SDL_CONTROLLER_BUTTON_DPAD_RIGHT);
+    gba->io.keyinput.up &=
+        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_UP);
+    gba->io.keyinput.down &= ~SDL_GameControllerGetButton(
+        controller, SDL_CONTROLLER_BUTTON_DPAD_DOWN);
+    gba->io.keyinput.l &= ~SDL_GameControllerGetButton(
+        controller, SDL_CONTROLLER_BUTTON_LEFTSHOULDER);
+    gba->io.keyinput.r &= ~SDL_GameControllerGetButton(
+        controller, SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);
+}
+
+void queue_samples(SDL_AudioDeviceID audio, float* samples) {
+    Uint32 target = agbemu.audio_latency * SAMPLE_FREQ / 1000 * 2 * sizeof(float);
+    Uint32 queued = SDL_GetQueuedAudioSize(audio);
+    if (!agbemu.vsync) {
+        SDL_QueueAudio(audio, samples, SAMPLE_BUF_LEN * sizeof(float));
+        return;
+    }
+    if (queued > 2 * target) return;
+
+    double fill = ((double) target - queued) / target;
+    if (fill < -1) fill = -1;
+    int len = drc_resample(samples, SAMPLE_BUF_LEN / 2, drc_buf, SAMPLE_BUF_LEN,
+                           1 + DRC_MAX_DELTA * fill);
+    SDL_QueueAudio(audio, drc_buf, 2 * len * sizeof(float));
+}
+
 int main(int argc, char** argv) {
 
     if (emulator_init(argc, argv) < 0) return -1;
@@ -39,6 +155,8 @@ int main(int argc, char** argv) {
         controller = SDL_GameControllerOpen(0);
     }
 
+    if (agbemu.vsync) SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
+
     SDL_Window* window;
     SDL_Renderer* renderer;
     SDL_CreateWindowAndRenderer(GBA_SCREEN_W * 2, GBA_SCREEN_H * 2, SDL_WINDOW_RESIZABLE, &window,
@@ -60,25 +178,28 @@ int main(int argc, char** argv) {
     Uint64 prev_time = SDL_GetPerformanceCounter();
     Uint64 prev_fps_update = prev_time;
     Uint64 prev_fps_frame = 0;
+    PpuStats prev_stats = ppu_stats;
     const Uint64 frame_ticks = SDL_GetPerformanceFrequency() / 60;
     Uint64 frame = 0;
+    bool late = false;
 
     agbemu.running = !agbemu.debugger;
     while (true) {
         while (agbemu.running) {
             Uint64 cur_time;
             Uint64 elapsed;
-            bool play_audio = !(agbemu.pause || agbemu.mute || agbemu.uncap || agbemu.gba->stop) &&
+            bool play_audio = !(agbemu.pause || agbemu.mute || agbemu.uncap || agbemu.silent ||
+                                agbemu.gba->stop) &&
                               (agbemu.gba->io.nr52 & (1 << 7));
 
             if (!(agbemu.pause || agbemu.gba->stop)) {
                 do {
+                    agbemu.gba->ppu.skip_frame = skip_next_frame(late);
                     while (!agbemu.gba->stop && !agbemu.gba->ppu.frame_complete) {
                         gba_step(agbemu.gba);
                         if (agbemu.gba->apu.samples_full) {
                             if (play_audio) {
-                                SDL_QueueAudio(audio, agbemu.gba->apu.sample_buf,
-                                               sizeof agbemu.gba->apu.sample_buf);
+                                queue_samples(audio, agbemu.gba->apu.sample_buf);
                             }
                             agbemu.gba->apu.samples_full = false;
                         }
@@ -86,16 +207,23 @@ int main(int argc, char** argv) {
                     agbemu.gba->ppu.frame_complete = false;
                     frame++;
 
+                    if (agbemu.gba->apu.deferred) {
+                        static float sample_buf[SAMPLE_BUF_LEN];
+                        apu_thread_sync(agbemu.gba);
+                        while (apu_thread_samples(sample_buf)) {
+                            if (play_audio) queue_samples(audio, sample_buf);
+                        }
+                    }
+
                     cur_time = SDL_GetPerformanceCounter();
                     elapsed = cur_time - prev_time;
                 } while (agbemu.uncap && elapsed < frame_ticks);
             }
 
-            void* pixels;
-            int pitch;
-            SDL_LockTexture(texture, NULL, &pixels, &pitch);
-            gba_convert_screen((hword*) agbemu.gba->ppu.screen, pixels);
-            SDL_UnlockTexture(texture);
+            if (!agbemu.gba->ppu.skip_frame) {
+                SDL_UpdateTexture(texture, NULL, agbemu.gba->ppu_cache.screen,
+                                  sizeof agbemu.gba->ppu_cache.screen[0]);
+            }
 
             int windowW, windowH;
             SDL_GetWindowSize(window, &windowW, &windowH);
@@ -117,9 +245,18 @@ int main(int argc, char** argv) {
             cur_time = SDL_GetPerformanceCounter();
             elapsed = cur_time - prev_time;
             Sint64 wait = frame_ticks - elapsed;
+            late = wait < 0;
 
-            if (play_audio) {
-                while (SDL_GetQueuedAudioSize(audio) >= 16 * SAMPLE_BUF_LEN) SDL_Delay(1);
+            if (agbemu.vsync) {
+                // presenting already waited for vsync and the audio rate
+                // follows the display through queue_samples
+            } else if (play_audio) {
+                Uint32 target = agbemu.audio_latency * SAMPLE_FREQ / 1000 * 2 * sizeof(float);
+                Uint32 queued = SDL_GetQueuedAudioSize(audio);
+                if (queued > target) {
+                    SDL_Delay((Uint64) (queued - target) * 1000 /
+                              (SAMPLE_FREQ * 2 * sizeof(float)));
+                }
             } else if (wait > 0 && !agbemu.uncap) {
                 SDL_Delay(wait * 1000 / SDL_GetPerformanceFrequency());
             }
@@ -128,10 +265,15 @@ int main(int argc, char** argv) {
             if (elapsed >= SDL_GetPerformanceFrequency() / 2) {
                 double fps =
                     (double) SDL_GetPerformanceFrequency() * (frame - prev_fps_frame) / elapsed;
-                snprintf(wintitle, 199, "agbemu | %s | %.2lf FPS", agbemu.romfilenodir, fps);
+                dword drawn = ppu_stats.lines_drawn - prev_stats.lines_drawn;
+                dword reused = ppu_stats.lines_reused - prev_stats.lines_reused;
+                double reuse = drawn + reused ? 100.0 * reused / (drawn + reused) : 0;
+                snprintf(wintitle, 199, "agbemu | %s | %.2lf FPS | %.0lf%% lines reused",
+                         agbemu.romfilenodir, fps, reuse);
                 SDL_SetWindowTitle(window, wintitle);
                 prev_fps_update = cur_time;
                 prev_fps_frame = frame;
+                prev_stats = ppu_stats;
             }
             prev_time = cur_time;
         }
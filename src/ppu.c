@@ -1,14 +1,88 @@
 #include "ppu.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "dma.h"
 #include "gba.h"
 #include "io.h"
+#include "ppu_replay.h"
+#include "ppu_thread.h"
 #include "scheduler.h"
 
-extern bool filter;
+PpuStats ppu_stats;
+
+// bgr555 straight to host pixels. the format and color filter are
+// frontend settings shared by every gba, the table gets rebuilt by
+// whichever thread draws next. the render thread reads these and the
+// output buffer, so they only change while it is idle
+int host_pixfmt = PIXFMT_XRGB8888;
+bool host_filter;
+bool host_lut_valid;
+word host_lut[1 << 15];
+
+// finished lines go to the drawing gba's own screen unless the frontend
+// lends a buffer. reused lines rely on the last frame still being there,
+// which a lent buffer doesn't promise even at the same address, so lines
+// are only reused from the screen
+byte* host_out;
+word host_out_pitch;
+
+void ppu_set_pixfmt(int fmt, bool filter) {
+    ppu_thread_wait();
+    host_pixfmt = fmt;
+    host_filter = filter;
+    host_lut_valid = false;
+}
+
+void ppu_set_output(void* buf, word pitch) {
+    ppu_thread_wait();
+    host_out = buf;
+    host_out_pitch = pitch;
+}
+
+// the next lines are drawn in full even if nothing they read changed
+void ppu_forget_lines(PPU* ppu) {
+    memset(ppu->master->ppu_cache.line_cache_valid, 0,
+           sizeof ppu->master->ppu_cache.line_cache_valid);
+}
+
+static void build_host_lut() {
+    byte chan[32];
+    for (int i = 0; i < 32; i++) {
+        float c = (float) i / 31;
+        chan[i] = (host_filter ? pow(c, 1.7) : c) * 255;
+    }
+    for (int i = 0; i < 1 << 15; i++) {
+        byte r = chan[i & 0x1f];
+        byte g = chan[(i >> 5) & 0x1f];
+        byte b = chan[i >> 10];
+        if (host_pixfmt == PIXFMT_RGB565) {
+            host_lut[i] = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+        } else {
+            host_lut[i] = r << 16 | g << 8 | b;
+        }
+    }
+    host_lut_valid = true;
+}
+
+static inline word host_color(hword c) {
+    return host_lut[c & 0x7fff];
+}
+
+static inline void* screen_row(PPU* ppu) {
+    if (host_out) return host_out + ppu->ly * host_out_pitch;
+    return ppu->master->ppu_cache.screen[ppu->ly];
+}
+
+static inline void put_pixel(PPU* ppu, int x, hword c) {
+    if (host_pixfmt == PIXFMT_RGB565) {
+        ((hword*) screen_row(ppu))[x] = host_color(c);
+    } else {
+        ((word*) screen_row(ppu))[x] = host_color(c);
+    }
+}
 
 const int SCLAYOUT[4][2][2] = {
     {{0, 0}, {0, 0}}, {{0, 1}, {0, 1}}, {{0, 0}, {1, 1}}, {{0, 1}, {2, 3}}};
@@ -16,7 +90,161 @@ const int SCLAYOUT[4][2][2] = {
 // size: sqr, short, long
 const int OBJLAYOUT[4][3] = {{8, 8, 16}, {16, 8, 32}, {32, 16, 32}, {64, 32, 64}};
 
-void render_bg_line_text(PPU* ppu, int bg) {
+void ppu_invalidate_caches(GBA* gba) {
+    memset(gba->ppu_cache.tile_cache_valid, 0, sizeof gba->ppu_cache.tile_cache_valid);
+    gba->ppu_cache.obj_lists_valid = false;
+    ppu_forget_lines(&gba->ppu);
+}
+
+void ppu_tiles_dirty(GBA* gba, word addr, word len) {
+    for (word slot = addr >> 5; slot <= (addr + len - 1) >> 5; slot++) {
+        gba->ppu_cache.tile_cache_valid[slot] = false;
+    }
+}
+
+void ppu_objs_dirty(GBA* gba, word addr, word len) {
+    for (word a = addr & ~7; a < addr + len; a += 8) {
+        if (a + 4 > addr) gba->ppu_cache.obj_list_dirty[a >> 9] |= 1ULL << ((a >> 3) & 63);
+    }
+}
+
+static bool obj_size(ObjAttr o, byte* w, byte* h) {
+    switch (o.shape) {
+        case OBJ_SHAPE_SQR:
+            *w = *h = OBJLAYOUT[o.size][0];
+            break;
+        case OBJ_SHAPE_HORZ:
+            *w = OBJLAYOUT[o.size][2];
+            *h = OBJLAYOUT[o.size][1];
+            break;
+        case OBJ_SHAPE_VERT:
+            *w = OBJLAYOUT[o.size][1];
+            *h = OBJLAYOUT[o.size][2];
+            break;
+        default:
+            return false;
+    }
+    if (o.disable_double) {
+        if (o.aff) {
+            *w *= 2;
+            *h *= 2;
+        } else return false;
+    }
+    return true;
+}
+
+static void update_obj_lists(PPU* ppu) {
+    PpuCache* c = &ppu->master->ppu_cache;
+    if (!c->obj_lists_valid) {
+        c->obj_lists_valid = true;
+        memset(c->obj_lines, 0, sizeof c->obj_lines);
+        memset(c->obj_list_h, 0, sizeof c->obj_list_h);
+        c->obj_list_dirty[0] = c->obj_list_dirty[1] = ~0ULL;
+    }
+    for (int k = 0; k < 2; k++) {
+        while (c->obj_list_dirty[k]) {
+            int i = 64 * k + __builtin_ctzll(c->obj_list_dirty[k]);
+            c->obj_list_dirty[k] &= c->obj_list_dirty[k] - 1;
+            dword bit = 1ULL << (i & 63);
+
+            for (int l = 0; l < GBA_SCREEN_H; l++) {
+                if ((byte) (l - c->obj_list_y[i]) < c->obj_list_h[i]) {
+                    c->obj_lines[l][k] &= ~bit;
+                }
+            }
+            byte w, h;
+            ObjAttr o = ppu->master->oam.objs[i];
+            c->obj_list_y[i] = o.y;
+            c->obj_list_h[i] = obj_size(o, &w, &h) ? h : 0;
+            for (int l = 0; l < GBA_SCREEN_H; l++) {
+                if ((byte) (l - c->obj_list_y[i]) < c->obj_list_h[i]) {
+                    c->obj_lines[l][k] |= bit;
+                }
+            }
+        }
+    }
+}
+
+static inline dword tile_row_4bpp(PPU* ppu, word addr, bool hflip) {
+    word slot = addr >> 5;
+    PpuCache* c = &ppu->master->ppu_cache;
+    if (!c->tile_cache_valid[slot]) {
+        for (int r = 0; r < 8; r++) {
+            word w = ppu->master->vram.w[8 * slot + r];
+            dword d = 0;
+            for (int i = 0; i < 8; i++, w >>= 4) {
+                d |= (dword) (w & 0xf) << 8 * i;
+            }
+            c->tile_cache[slot][r] = d;
+        }
+        c->tile_cache_valid[slot] = true;
+    }
+    dword row = c->tile_cache[slot][(addr >> 2) & 7];
+    return hflip ? __builtin_bswap64(row) : row;
+}
+
+static inline dword tile_row_8bpp(PPU* ppu, word addr, bool hflip) {
+    dword row = ppu->master->vram.w[addr >> 2];
+    row |= (dword) ppu->master->vram.w[(addr + 4) >> 2] << 32;
+    return hflip ? __builtin_bswap64(row) : row;
+}
+
+static inline dword bg_tile_row(PPU* ppu, BgTile tile, word tile_start, hword fy, bool palmode) {
+    if (tile.vflip) fy = 7 - fy;
+    if (palmode) {
+        return tile_row_8bpp(ppu, (tile_start + 64 * tile.num + 8 * fy) % 0x10000, tile.hflip);
+    } else {
+        return tile_row_4bpp(ppu, (tile_start + 32 * tile.num + 4 * fy) % 0x10000, tile.hflip);
+    }
+}
+
+// 8 pixels per 128 bit vector, gcc lowers this to sse2 or neon
+#define VLEN 8
+typedef hword hvec __attribute__((vector_size(2 * VLEN)));
+typedef shword mvec __attribute__((vector_size(2 * VLEN)));
+
+// affine texel coordinates are computed 8 dots at a time, the loads that
+// follow are still one per lane since there is no gather to lower them to
+typedef sword svec __attribute__((vector_size(4 * VLEN)));
+typedef word wvec __attribute__((vector_size(4 * VLEN)));
+
+static const svec lanes = {0, 1, 2, 3, 4, 5, 6, 7};
+
+// without the filter a channel scales to c * 255 / 31, which is
+// c * 1053 >> 7 for 8 bits and c * 527 >> 8 for 6, so the conversion
+// needs no lookups and stays in vectors
+static inline void put_pixels(PPU* ppu, int x, hvec c) {
+    if (host_filter) {
+        if (host_pixfmt == PIXFMT_RGB565) {
+            hword* row = screen_row(ppu);
+            for (int i = 0; i < VLEN; i++) row[x + i] = host_color(c[i]);
+        } else {
+            word* row = screen_row(ppu);
+            for (int i = 0; i < VLEN; i++) row[x + i] = host_color(c[i]);
+        }
+        return;
+    }
+    hvec r = c & 0x1f;
+    hvec g = c >> 5 & 0x1f;
+    hvec b = c >> 10 & 0x1f;
+    if (host_pixfmt == PIXFMT_RGB565) {
+        hvec px = r << 11 | (g * 527 >> 8) << 5 | b;
+        memcpy((hword*) screen_row(ppu) + x, &px, sizeof px);
+    } else {
+        wvec px = __builtin_convertvector(r * 1053 >> 7, wvec) << 16 |
+                  __builtin_convertvector(g * 1053 >> 7, wvec) << 8 |
+                  __builtin_convertvector(b * 1053 >> 7, wvec);
+        memcpy((word*) screen_row(ppu) + x, &px, sizeof px);
+    }
+}
+
+// the line renderers are written once with the variant as constant
+// arguments and stamped out per variant below, so the per dot loops carry
+// no mode or depth checks. mosaic only changes where a line starts
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+static ALWAYS_INLINE void render_bg_line_text(PPU* ppu, int bg, hword* pal,
+                                              const bool palmode) {
     if (!(ppu->master->io.dispcnt.bg_enable & (1 << bg))) return;
     ppu->draw_bg[bg] = true;
 
@@ -39,96 +267,36 @@ void render_bg_line_text(PPU* ppu, int bg) {
     byte scs[2] = {SCLAYOUT[ppu->master->io.bgcnt[bg].size][scy & 1][0],
                    SCLAYOUT[ppu->master->io.bgcnt[bg].size][scy & 1][1]};
     word map_addr = map_start + 0x800 * scs[scx & 1] + 32 * 2 * ty + 2 * tx;
-    BgTile tile = {ppu->master->vram.h[(map_addr % 0x10000) >> 1]};
-    if (ppu->master->io.bgcnt[bg].palmode) {
-        word tile_addr = tile_start + 64 * tile.num;
-        hword tmpfy = fy;
-        if (tile.vflip) tmpfy = 7 - fy;
-        dword row = ppu->master->vram.w[((tile_addr + 8 * tmpfy) % 0x10000) >> 2];
-        row |= (dword) ppu->master->vram.w[((tile_addr + 8 * tmpfy + 4) % 0x10000) >> 2] << 32;
-        if (tile.hflip) {
-            row = (row & 0xffffffff00000000) >> 32 | (row & 0x00000000ffffffff) << 32;
-            row = (row & 0xffff0000ffff0000) >> 16 | (row & 0x0000ffff0000ffff) << 16;
-            row = (row & 0xff00ff00ff00ff00) >> 8 | (row & 0x00ff00ff00ff00ff) << 8;
-        }
-        row >>= 8 * fx;
-        for (int x = 0; x < GBA_SCREEN_W; x++) {
-            byte col_ind = row & 0xff;
-            if (col_ind) ppu->layerlines[bg][x] = ppu->master->pram.h[col_ind] & ~(1 << 15);
-            else ppu->layerlines[bg][x] = 1 << 15;
 
-            row >>= 8;
-            fx++;
-            if (fx == 8) {
-                fx = 0;
-                tx++;
-                if (tx == 32) {
-                    tx = 0;
-                    scx++;
-                    map_addr = map_start + 0x800 * scs[scx & 1] + 32 * 2 * ty;
-                } else {
-                    map_addr += 2;
-                }
-                tile.h = ppu->master->vram.h[(map_addr % 0x10000) >> 1];
-                tile_addr = tile_start + 64 * tile.num;
-                tmpfy = fy;
-                if (tile.vflip) tmpfy = 7 - fy;
-                row = ppu->master->vram.w[((tile_addr + 8 * tmpfy) % 0x10000) >> 2];
-                row |= (dword) ppu->master->vram.w[((tile_addr + 8 * tmpfy + 4) % 0x10000) >> 2]
-                       << 32;
-                if (tile.hflip) {
-                    row = (row & 0xffffffff00000000) >> 32 | (row & 0x00000000ffffffff) << 32;
-                    row = (row & 0xffff0000ffff0000) >> 16 | (row & 0x0000ffff0000ffff) << 16;
-                    row = (row & 0xff00ff00ff00ff00) >> 8 | (row & 0x00ff00ff00ff00ff) << 8;
-                }
+    // whole tiles go into a buffer that starts fx dots left of the screen
+    hword span[GBA_SCREEN_W + 8];
+    for (int x = 0; x < GBA_SCREEN_W + 8; x += 8) {
+        BgTile tile = {ppu->master->vram.h[(map_addr % 0x10000) >> 1]};
+        dword row = bg_tile_row(ppu, tile, tile_start, fy, palmode);
+        if (row) {
+            byte bank = palmode ? 0 : tile.palette << 4;
+            for (int i = 0; i < 8; i++, row >>= 8) {
+                span[x + i] = pal[(row & 0xff) | bank];
             }
+        } else {
+            for (int i = 0; i < 8; i++) span[x + i] = 1 << 15;
         }
-    } else {
-        word tile_addr = tile_start + 32 * tile.num;
-        hword tmpfy = fy;
-        if (tile.vflip) tmpfy = 7 - fy;
-        word row = ppu->master->vram.w[((tile_addr + 4 * tmpfy) % 0x10000) >> 2];
-        if (tile.hflip) {
-            row = (row & 0xffff0000) >> 16 | (row & 0x0000ffff) << 16;
-            row = (row & 0xff00ff00) >> 8 | (row & 0x00ff00ff) << 8;
-            row = (row & 0xf0f0f0f0) >> 4 | (row & 0x0f0f0f0f) << 4;
-        }
-        row >>= 4 * fx;
-        for (int x = 0; x < GBA_SCREEN_W; x++) {
-            byte col_ind = row & 0xf;
-            if (col_ind) {
-                col_ind |= tile.palette << 4;
-                ppu->layerlines[bg][x] = ppu->master->pram.h[col_ind] & ~(1 << 15);
-            } else ppu->layerlines[bg][x] = 1 << 15;
 
-            row >>= 4;
-            fx++;
-            if (fx == 8) {
-                fx = 0;
-                tx++;
-                if (tx == 32) {
-                    tx = 0;
-                    scx++;
-                    map_addr = map_start + 0x800 * scs[scx & 1] + 32 * 2 * ty;
-                } else {
-                    map_addr += 2;
-                }
-                tile.h = ppu->master->vram.h[(map_addr % 0x10000) >> 1];
-                tile_addr = tile_start + 32 * tile.num;
-                tmpfy = fy;
-                if (tile.vflip) tmpfy = 7 - fy;
-                row = ppu->master->vram.w[((tile_addr + 4 * tmpfy) % 0x10000) >> 2];
-                if (tile.hflip) {
-                    row = (row & 0xffff0000) >> 16 | (row & 0x0000ffff) << 16;
-                    row = (row & 0xff00ff00) >> 8 | (row & 0x00ff00ff) << 8;
-                    row = (row & 0xf0f0f0f0) >> 4 | (row & 0x0f0f0f0f) << 4;
-                }
-            }
+        tx++;
+        if (tx == 32) {
+            tx = 0;
+            scx++;
+            map_addr = map_start + 0x800 * scs[scx & 1] + 32 * 2 * ty;
+        } else {
+            map_addr += 2;
         }
     }
+    memcpy(ppu->layerlines[bg], &span[fx], sizeof ppu->layerlines[bg]);
 }
 
-void render_bg_line_aff(PPU* ppu, int bg, int mode) {
+// mode is 2 for tiled affine backgrounds in modes 1 and 2
+static ALWAYS_INLINE void render_bg_line_aff(PPU* ppu, int bg, hword* pal, const int mode,
+                                             const bool overflow) {
     if (!(ppu->master->io.dispcnt.bg_enable & (1 << bg))) return;
     ppu->draw_bg[bg] = true;
 
@@ -144,109 +312,154 @@ void render_bg_line_aff(PPU* ppu, int bg, int mode) {
         x0 = ppu->bgaffintr[bg - 2].x;
         y0 = ppu->bgaffintr[bg - 2].y;
     }
+    shword pa = ppu->master->io.bgaff[bg - 2].pa;
+    shword pc = ppu->master->io.bgaff[bg - 2].pc;
 
     hword size = 1 << (7 + ppu->master->io.bgcnt[bg].size);
+    word w = mode == 5 ? 160 : mode > 2 ? GBA_SCREEN_W : size;
+    word h = mode == 5 ? 128 : mode > 2 ? GBA_SCREEN_H : size;
 
-    for (int x = 0; x < GBA_SCREEN_W;
-         x++, x0 += ppu->master->io.bgaff[bg - 2].pa, y0 += ppu->master->io.bgaff[bg - 2].pc) {
-        word sx = x0 >> 8;
+    // an unscaled bitmap line is a copy of part of one row
+    if (mode > 2 && pa == 1 << 8 && pc == 0) {
+        sword sx0 = x0 >> 8;
         word sy = y0 >> 8;
-        if (((mode < 3) && (sx >= size || sy >= size) && !ppu->master->io.bgcnt[bg].overflow) ||
-            ((mode == 3 || mode == 4) && (sx >= GBA_SCREEN_W || sy >= GBA_SCREEN_H)) ||
-            ((mode == 5) && (sx >= 160 || sy >= 128))) {
-            ppu->layerlines[bg][x] = 1 << 15;
-            continue;
-        }
-
-        byte col_ind = 0;
-        bool pal = true;
-        switch (mode) {
-            case 1:
-            case 2:
-                sx &= size - 1;
-                sy &= size - 1;
-                hword tilex = sx >> 3;
-                hword tiley = sy >> 3;
-                hword finex = sx & 0b111;
-                hword finey = sy & 0b111;
-                byte tile =
-                    ppu->master->vram.b[(map_start + tiley * (size >> 3) + tilex) % 0x10000];
-                col_ind =
-                    ppu->master->vram.b[(tile_start + 64 * tile + finey * 8 + finex) % 0x10000];
-                break;
-            case 3:
-                pal = false;
-                ppu->layerlines[bg][x] = ppu->master->vram.h[sy * GBA_SCREEN_W + sx] & ~(1 << 15);
-                break;
-            case 4:
-                col_ind = ppu->master->vram.b[bm_start + sy * GBA_SCREEN_W + sx];
-                break;
-            case 5:
-                pal = false;
-                ppu->layerlines[bg][x] =
-                    ppu->master->vram.h[(bm_start >> 1) + sy * 160 + sx] & ~(1 << 15);
-                break;
-        }
-        if (pal) {
-            if (col_ind) ppu->layerlines[bg][x] = ppu->master->pram.h[col_ind] & ~(1 << 15);
-            else ppu->layerlines[bg][x] = 1 << 15;
+        int lo = 0, hi = 0;
+        if (sy < h) {
+            lo = sx0 < 0 ? -sx0 : 0;
+            hi = (sword) w - sx0;
+        }
+        if (lo > GBA_SCREEN_W) lo = GBA_SCREEN_W;
+        if (hi > GBA_SCREEN_W) hi = GBA_SCREEN_W;
+        if (hi < lo) hi = lo;
+
+        for (int x = 0; x < lo; x++) ppu->layerlines[bg][x] = 1 << 15;
+        if (mode == 3) {
+            hword* row = &ppu->master->vram.h[sy * GBA_SCREEN_W];
+            for (int x = lo; x < hi; x++) ppu->layerlines[bg][x] = row[sx0 + x] & ~(1 << 15);
+        } else if (mode == 4) {
+            byte* row = &ppu->master->vram.b[bm_start + sy * GBA_SCREEN_W];
+            for (int x = lo; x < hi; x++) ppu->layerlines[bg][x] = pal[row[sx0 + x]];
+        } else {
+            hword* row = &ppu->master->vram.h[(bm_start >> 1) + sy * 160];
+            for (int x = lo; x < hi; x++) ppu->layerlines[bg][x] = row[sx0 + x] & ~(1 << 15);
         }
+        for (int x = hi; x < GBA_SCREEN_W; x++) ppu->layerlines[bg][x] = 1 << 15;
+        return;
     }
+
+    for (int x = 0; x < GBA_SCREEN_W; x += VLEN) {
+        wvec sx = (wvec) ((x0 + (x + lanes) * pa) >> 8);
+        wvec sy = (wvec) ((y0 + (x + lanes) * pc) >> 8);
+        svec clip = {};
+        if (!overflow) clip = (sx >= w) | (sy >= h);
+
+        wvec ind;
+        if (mode == 2) {
+            sx &= size - 1;
+            sy &= size - 1;
+            wvec map_addr = (map_start + (sy >> 3) * (size >> 3) + (sx >> 3)) % 0x10000;
+            wvec tile_addr = tile_start + 8 * (sy & 7) + (sx & 7);
+            for (int i = 0; i < VLEN; i++) {
+                ind[i] = (tile_addr[i] + 64 * ppu->master->vram.b[map_addr[i]]) % 0x10000;
+            }
+        } else if (mode == 4) {
+            ind = bm_start + sy * GBA_SCREEN_W + sx;
+        } else if (mode == 3) {
+            ind = sy * GBA_SCREEN_W + sx;
+        } else {
+            ind = (bm_start >> 1) + sy * 160 + sx;
+        }
+        // clipped dots load from 0 instead of outside vram
+        ind &= ~(wvec) clip;
+
+        for (int i = 0; i < VLEN; i++) {
+            hword col;
+            if (mode == 2 || mode == 4) col = pal[ppu->master->vram.b[ind[i]]];
+            else col = ppu->master->vram.h[ind[i]] & ~(1 << 15);
+            ppu->layerlines[bg][x + i] = clip[i] ? 1 << 15 : col;
+        }
+    }
+}
+
+// name, renderer, constant variant arguments
+#define BG_VARIANTS(X)                                                                             \
+    X(render_bg_text_4bpp, render_bg_line_text, false)                                             \
+    X(render_bg_text_8bpp, render_bg_line_text, true)                                              \
+    X(render_bg_aff_clip, render_bg_line_aff, 2, false)                                            \
+    X(render_bg_aff_wrap, render_bg_line_aff, 2, true)                                             \
+    X(render_bg_mode3, render_bg_line_aff, 3, false)                                               \
+    X(render_bg_mode4, render_bg_line_aff, 4, false)                                               \
+    X(render_bg_mode5, render_bg_line_aff, 5, false)
+
+#define X(name, renderer, ...)                                                                     \
+    static void name(PPU* ppu, int bg, hword* pal) {                                               \
+        renderer(ppu, bg, pal, __VA_ARGS__);                                                       \
+    }
+BG_VARIANTS(X)
+#undef X
+
+static inline void render_bg_text(PPU* ppu, int bg, hword (*pal)[256]) {
+    if (ppu->master->io.bgcnt[bg].palmode) render_bg_text_8bpp(ppu, bg, pal[1]);
+    else render_bg_text_4bpp(ppu, bg, pal[0]);
+}
+
+static inline void render_bg_aff(PPU* ppu, int bg, hword (*pal)[256]) {
+    if (ppu->master->io.bgcnt[bg].overflow) render_bg_aff_wrap(ppu, bg, pal[1]);
+    else render_bg_aff_clip(ppu, bg, pal[1]);
 }
 
 void render_bgs(PPU* ppu) {
+    if (!ppu->master->io.dispcnt.bg_enable) return;
+
+    // bg palette with the transparent entries folded in so every dot is a
+    // single lookup, [0] is for 4bpp where each bank starts with one
+    hword pal[2][256];
+    for (int i = 0; i < 256; i++) {
+        hword c = ppu->master->pram.h[i] & ~(1 << 15);
+        pal[0][i] = (i & 0xf) ? c : 1 << 15;
+        pal[1][i] = i ? c : 1 << 15;
+    }
+
     switch (ppu->master->io.dispcnt.bg_mode) {
         case 0:
-            render_bg_line_text(ppu, 0);
-            render_bg_line_text(ppu, 1);
-            render_bg_line_text(ppu, 2);
-            render_bg_line_text(ppu, 3);
+            render_bg_text(ppu, 0, pal);
+            render_bg_text(ppu, 1, pal);
+            render_bg_text(ppu, 2, pal);
+            render_bg_text(ppu, 3, pal);
             break;
         case 1:
-            render_bg_line_text(ppu, 0);
-            render_bg_line_text(ppu, 1);
-            render_bg_line_aff(ppu, 2, 1);
+            render_bg_text(ppu, 0, pal);
+            render_bg_text(ppu, 1, pal);
+            render_bg_aff(ppu, 2, pal);
             break;
         case 2:
-            render_bg_line_aff(ppu, 2, 2);
-            render_bg_line_aff(ppu, 3, 2);
+            render_bg_aff(ppu, 2, pal);
+            render_bg_aff(ppu, 3, pal);
             break;
         case 3:
-            render_bg_line_aff(ppu, 2, 3);
+            render_bg_mode3(ppu, 2, pal[1]);
             break;
         case 4:
-            render_bg_line_aff(ppu, 2, 4);
+            render_bg_mode4(ppu, 2, pal[1]);
             break;
         case 5:
-            render_bg_line_aff(ppu, 2, 5);
+            render_bg_mode5(ppu, 2, pal[1]);
             break;
     }
 }
 
+static inline dword obj_tile_row(PPU* ppu, word tile_addr, byte fy, bool palmode, bool hflip) {
+    if (palmode) {
+        return tile_row_8bpp(ppu, 0x10000 + (tile_addr + 8 * fy) % 0x8000, hflip);
+    } else {
+        return tile_row_4bpp(ppu, 0x10000 + (tile_addr + 4 * fy) % 0x8000, hflip);
+    }
+}
+
 void render_obj_line(PPU* ppu, int i) {
     ObjAttr o = ppu->master->oam.objs[i];
     byte w, h;
-    switch (o.shape) {
-        case OBJ_SHAPE_SQR:
-            w = h = OBJLAYOUT[o.size][0];
-            break;
-        case OBJ_SHAPE_HORZ:
-            w = OBJLAYOUT[o.size][2];
-            h = OBJLAYOUT[o.size][1];
-            break;
-        case OBJ_SHAPE_VERT:
-            w = OBJLAYOUT[o.size][1];
-            h = OBJLAYOUT[o.size][2];
-            break;
-        default:
-            return;
-    }
-    if (o.disable_double) {
-        if (o.aff) {
-            w *= 2;
-            h *= 2;
-        } else return;
-    }
+    if (!obj_size(o, &w, &h)) return;
 
     byte yofs = ppu->ly - (byte) o.y;
     if (yofs >= h) return;
@@ -279,44 +492,43 @@ void render_obj_line(PPU* ppu, int i) {
         sword x0 = pa * (-w / 2) + pb * (yofs - h / 2) + ((ow / 2) << 8);
         sword y0 = pc * (-w / 2) + pd * (yofs - h / 2) + ((oh / 2) << 8);
 
-        for (int x = 0; x < w; x++, x0 += pa, y0 += pc) {
+        word stride = (o.palmode ? 64 : 32) *
+                      (ppu->master->io.dispcnt.obj_mapmode ? ow / 8 : o.palmode ? 16 : 32);
+        hword cols[128];
+        for (int x = 0; x < w; x += VLEN) {
+            svec vx = x0 + (x + lanes) * pa;
+            svec vy = y0 + (x + lanes) * pc;
+            wvec ty = (wvec) (vy >> 11) & 0xffff;
+            wvec tx = (wvec) (vx >> 11) & 0xffff;
+            wvec fy = (wvec) (vy >> 8) & 0b111;
+            wvec fx = (wvec) (vx >> 8) & 0b111;
+            svec in = (ty < oh / 8) & (tx < ow / 8);
+
+            wvec tile_addr;
+            if (o.palmode) tile_addr = tile_start + ty * stride + 64 * tx + 8 * fy + fx;
+            else tile_addr = tile_start + ty * stride + 32 * tx + 4 * fy + fx / 2;
+            tile_addr = 0x10000 + tile_addr % 0x8000;
+
+            for (int i = 0; i < VLEN; i++) {
+                byte col_ind = ppu->master->vram.b[tile_addr[i]];
+                if (!o.palmode) {
+                    col_ind = (fx[i] & 1) ? col_ind >> 4 : col_ind & 0b1111;
+                    if (col_ind) col_ind |= o.palette << 4;
+                }
+                if (in[i] && col_ind) {
+                    cols[x + i] = ppu->master->pram.h[0x100 + col_ind] & ~(1 << 15);
+                } else cols[x + i] = 1 << 15;
+            }
+        }
+
+        for (int x = 0; x < w; x++) {
             hword sx = (o.x + x) % 512;
             if (sx >= GBA_SCREEN_W) continue;
 
-            hword ty = y0 >> 11;
-            hword fy = (y0 >> 8) & 0b111;
-            hword tx = x0 >> 11;
-            hword fx = (x0 >> 8) & 0b111;
-
-            hword col;
-
-            if (ty >= oh / 8 || tx >= ow / 8) {
-                col = 1 << 15;
-            } else {
-                if (o.palmode) {
-                    word tile_addr =
-                        tile_start + ty * 64 * (ppu->master->io.dispcnt.obj_mapmode ? ow / 8 : 16);
-                    tile_addr += 64 * tx + 8 * fy + fx;
-                    byte col_ind = ppu->master->vram.b[0x10000 + tile_addr % 0x8000];
-                    if (col_ind) {
-                        col = ppu->master->pram.h[0x100 + col_ind] & ~(1 << 15);
-                    } else col = 1 << 15;
-                } else {
-                    word tile_addr =
-                        tile_start + ty * 32 * (ppu->master->io.dispcnt.obj_mapmode ? ow / 8 : 32);
-                    tile_addr += 32 * tx + 4 * fy + fx / 2;
-                    byte col_ind = ppu->master->vram.b[0x10000 + tile_addr % 0x8000];
-                    if (fx & 1) col_ind >>= 4;
-                    else col_ind &= 0b1111;
-                    if (col_ind) {
-                        col_ind |= o.palette << 4;
-                        col = ppu->master->pram.h[0x100 + col_ind] & ~(1 << 15);
-                    } else col = 1 << 15;
-                }
-            }
+            hword col = cols[x];
             if (o.mode == OBJ_MODE_OBJWIN) {
                 if (ppu->master->io.dispcnt.winobj_enable && !(col & (1 << 15))) {
-                    ppu->window[sx] = WOBJ;
+                    ppu->objwin[sx >> 6] |= 1ULL << (sx & 63);
                 }
             } else if (o.priority < ppu->objdotattrs[sx].priority ||
                        (ppu->layerlines[LOBJ][sx] & (1 << 15))) {
@@ -338,117 +550,42 @@ void render_obj_line(PPU* ppu, int i) {
         byte ty = yofs >> 3;
         byte fy = yofs & 0b111;
 
+        // 2d mapping always has 1024 bytes per tile row
+        word tile_size = o.palmode ? 64 : 32;
+        tile_addr += ty * (ppu->master->io.dispcnt.obj_mapmode ? tile_size * (w / 8) : 1024);
+        if (o.hflip) tile_addr += tile_size * (w / 8 - 1);
+
         byte fx = 0;
-        if (o.palmode) {
-            tile_addr += ty * 64 * (ppu->master->io.dispcnt.obj_mapmode ? w / 8 : 16);
-            dword row;
-            if (o.hflip) {
-                tile_addr += 64 * (w / 8 - 1);
-                row = ppu->master->vram.w[(0x10000 + (tile_addr + 8 * fy) % 0x8000) >> 2];
-                row |=
-                    (dword) ppu->master->vram.w[(0x10000 + (tile_addr + 8 * fy + 4) % 0x8000) >> 2]
-                    << 32;
-                row = (row & 0xffffffff00000000) >> 32 | (row & 0x00000000ffffffff) << 32;
-                row = (row & 0xffff0000ffff0000) >> 16 | (row & 0x0000ffff0000ffff) << 16;
-                row = (row & 0xff00ff00ff00ff00) >> 8 | (row & 0x00ff00ff00ff00ff) << 8;
-            } else {
-                row = ppu->master->vram.w[(0x10000 + (tile_addr + 8 * fy) % 0x8000) >> 2];
-                row |=
-                    (dword) ppu->master->vram.w[(0x10000 + (tile_addr + 8 * fy + 4) % 0x8000) >> 2]
-                    << 32;
-            }
-            for (int x = 0; x < w; x++) {
-                int sx = (o.x + x) % 512;
-                if (sx < GBA_SCREEN_W) {
-                    byte col_ind = row & 0xff;
-                    if (o.mode == OBJ_MODE_OBJWIN) {
-                        if (ppu->master->io.dispcnt.winobj_enable && col_ind) {
-                            ppu->window[sx] = WOBJ;
-                        }
-                    } else if (o.priority < ppu->objdotattrs[sx].priority ||
-                               (ppu->layerlines[LOBJ][sx] & (1 << 15))) {
-                        if (col_ind) {
-                            hword col = ppu->master->pram.h[0x100 + col_ind];
-                            ppu->draw_obj = true;
-                            ppu->layerlines[LOBJ][sx] = col & ~(1 << 15);
-                            ppu->objdotattrs[sx].semitrans = (o.mode == OBJ_MODE_SEMITRANS) ? 1 : 0;
-                        }
-                        ppu->objdotattrs[sx].mosaic = o.mosaic;
-                        ppu->objdotattrs[sx].priority = o.priority;
+        dword row = obj_tile_row(ppu, tile_addr, fy, o.palmode, o.hflip);
+        for (int x = 0; x < w; x++) {
+            int sx = (o.x + x) % 512;
+            if (sx < GBA_SCREEN_W) {
+                byte col_ind = row & 0xff;
+                if (o.mode == OBJ_MODE_OBJWIN) {
+                    if (ppu->master->io.dispcnt.winobj_enable && col_ind) {
+                        ppu->objwin[sx >> 6] |= 1ULL << (sx & 63);
                     }
-                }
-
-                row >>= 8;
-                fx++;
-                if (fx == 8) {
-                    fx = 0;
-                    if (o.hflip) {
-                        tile_addr -= 64;
-                        row = ppu->master->vram.w[(0x10000 + (tile_addr + 8 * fy) % 0x8000) >> 2];
-                        row |= (dword) ppu->master->vram
-                                   .w[(0x10000 + (tile_addr + 8 * fy + 4) % 0x8000) >> 2]
-                               << 32;
-                        row = (row & 0xffffffff00000000) >> 32 | (row & 0x00000000ffffffff) << 32;
-                        row = (row & 0xffff0000ffff0000) >> 16 | (row & 0x0000ffff0000ffff) << 16;
-                        row = (row & 0xff00ff00ff00ff00) >> 8 | (row & 0x00ff00ff00ff00ff) << 8;
-                    } else {
-                        tile_addr += 64;
-                        row = ppu->master->vram.w[(0x10000 + (tile_addr + 8 * fy) % 0x8000) >> 2];
-                        row |= (dword) ppu->master->vram
-                                   .w[(0x10000 + (tile_addr + 8 * fy + 4) % 0x8000) >> 2]
-                               << 32;
+                } else if (o.priority < ppu->objdotattrs[sx].priority ||
+                           (ppu->layerlines[LOBJ][sx] & (1 << 15))) {
+                    if (col_ind) {
+                        if (!o.palmode) col_ind |= o.palette << 4;
+                        hword col = ppu->master->pram.h[0x100 + col_ind];
+                        ppu->draw_obj = true;
+                        ppu->layerlines[LOBJ][sx] = col & ~(1 << 15);
+                        ppu->objdotattrs[sx].semitrans = (o.mode == OBJ_MODE_SEMITRANS) ? 1 : 0;
                     }
+                    ppu->objdotattrs[sx].mosaic = o.mosaic;
+                    ppu->objdotattrs[sx].priority = o.priority;
                 }
             }
-        } else {
-            tile_addr += ty * 32 * (ppu->master->io.dispcnt.obj_mapmode ? w / 8 : 32);
-            word row;
-            if (o.hflip) {
-                tile_addr += 32 * (w / 8 - 1);
-                row = ppu->master->vram.w[(0x10000 + (tile_addr + 4 * fy) % 0x8000) >> 2];
-                row = (row & 0xffff0000) >> 16 | (row & 0x0000ffff) << 16;
-                row = (row & 0xff00ff00) >> 8 | (row & 0x00ff00ff) << 8;
-                row = (row & 0xf0f0f0f0) >> 4 | (row & 0x0f0f0f0f) << 4;
-            } else {
-                row = ppu->master->vram.w[(0x10000 + (tile_addr + 4 * fy) % 0x8000) >> 2];
-            }
-            for (int x = 0; x < w; x++) {
-                int sx = (o.x + x) % 512;
-
-                if (sx < GBA_SCREEN_W) {
-                    byte col_ind = row & 0xf;
-                    if (o.mode == OBJ_MODE_OBJWIN) {
-                        if (ppu->master->io.dispcnt.winobj_enable && col_ind) {
-                            ppu->window[sx] = WOBJ;
-                        }
-                    } else if (o.priority < ppu->objdotattrs[sx].priority ||
-                               (ppu->layerlines[LOBJ][sx] & (1 << 15))) {
-                        if (col_ind) {
-                            col_ind |= o.palette << 4;
-                            hword col = ppu->master->pram.h[0x100 + col_ind];
-                            ppu->draw_obj = true;
-                            ppu->layerlines[LOBJ][sx] = col & ~(1 << 15);
-                            ppu->objdotattrs[sx].semitrans = (o.mode == OBJ_MODE_SEMITRANS) ? 1 : 0;
-                        }
-                        ppu->objdotattrs[sx].mosaic = o.mosaic;
-                        ppu->objdotattrs[sx].priority = o.priority;
-                    }
-                }
-                row >>= 4;
-                fx++;
-                if (fx == 8) {
-                    fx = 0;
-                    if (o.hflip) {
-                        tile_addr -= 32;
-                        row = ppu->master->vram.w[(0x10000 + (tile_addr + 4 * fy) % 0x8000) >> 2];
-                        row = (row & 0xffff0000) >> 16 | (row & 0x0000ffff) << 16;
-                        row = (row & 0xff00ff00) >> 8 | (row & 0x00ff00ff) << 8;
-                        row = (row & 0xf0f0f0f0) >> 4 | (row & 0x0f0f0f0f) << 4;
-                    } else {
-                        tile_addr += 32;
-                        row = ppu->master->vram.w[(0x10000 + (tile_addr + 4 * fy) % 0x8000) >> 2];
-                    }
-                }
+
+            row >>= 8;
+            fx++;
+            if (fx == 8) {
+                fx = 0;
+                if (o.hflip) tile_addr -= tile_size;
+                else tile_addr += tile_size;
+                row = obj_tile_row(ppu, tile_addr, fy, o.palmode, o.hflip);
             }
         }
     }
@@ -463,22 +600,68 @@ void render_objs(PPU* ppu) {
 
     ppu->obj_cycles = (ppu->master->io.dispcnt.hblank_free ? GBA_SCREEN_W : DOTS_W) * 4 - 6;
 
-    for (int i = 0; i < 128; i++) {
-        render_obj_line(ppu, i);
-        if (ppu->obj_cycles <= 0) break;
+    // sprites off this line cost no cycles so skipping them is exact
+    update_obj_lists(ppu);
+    for (int k = 0; k < 2; k++) {
+        dword objs = ppu->master->ppu_cache.obj_lines[ppu->ly][k];
+        while (objs) {
+            render_obj_line(ppu, 64 * k + __builtin_ctzll(objs));
+            if (ppu->obj_cycles <= 0) return;
+            objs &= objs - 1;
+        }
     }
 }
 
+// sets the bits for dots lo <= x < hi
+static void mask_range(dword* m, int lo, int hi) {
+    for (int i = 0; i < WIN_WORDS; i++) {
+        int a = lo - 64 * i;
+        int b = hi - 64 * i;
+        if (a < 0) a = 0;
+        if (b > 64) b = 64;
+        if (a >= b) continue;
+        m[i] |= (b == 64 ? ~0ULL : (1ULL << b) - 1) & ~((1ULL << a) - 1);
+    }
+}
+
+static inline bool win_on(PPU* ppu, int layer, int x) {
+    return ppu->win_layers[layer][x >> 6] >> (x & 63) & 1;
+}
+
 void render_windows(PPU* ppu) {
-    if (!ppu->master->io.dispcnt.win_enable) return;
+    IO* io = &ppu->master->io;
+    if (!io->dispcnt.win_enable && !io->dispcnt.winobj_enable) {
+        memset(ppu->win_layers, 0xff, sizeof ppu->win_layers);
+        return;
+    }
 
-    for (int i = 1; i >= 0; i--) {
-        if (!(ppu->master->io.dispcnt.win_enable & (1 << i)) || !ppu->in_win[i]) continue;
+    // dots belonging to each window, win0 over win1 over the obj window
+    dword in[4][WIN_WORDS] = {};
+    for (int i = 0; i < 2; i++) {
+        if (!(io->dispcnt.win_enable & (1 << i)) || !ppu->in_win[i]) continue;
 
-        byte x1 = ppu->master->io.winh[i].x1;
-        byte x2 = ppu->master->io.winh[i].x2;
-        for (byte x = x1; x != x2; x++) {
-            if (x < GBA_SCREEN_W) ppu->window[x] = i;
+        byte x1 = io->winh[i].x1;
+        byte x2 = io->winh[i].x2;
+        if (x1 <= x2) {
+            mask_range(in[i], x1, x2);
+        } else {
+            mask_range(in[i], x1, 256);
+            mask_range(in[i], 0, x2);
+        }
+    }
+    for (int k = 0; k < WIN_WORDS; k++) {
+        in[WIN1][k] &= ~in[WIN0][k];
+        if (io->dispcnt.winobj_enable) in[WOBJ][k] = ppu->objwin[k] & ~in[WIN0][k] & ~in[WIN1][k];
+        in[WOUT][k] = ~(in[WIN0][k] | in[WIN1][k] | in[WOBJ][k]);
+    }
+
+    memset(ppu->win_layers, 0, sizeof ppu->win_layers);
+    for (int w = 0; w < 4; w++) {
+        byte ena = io->wincnt[w].bg_enable | io->wincnt[w].obj_enable << LOBJ |
+                   io->wincnt[w].effects_enable << LBD;
+        for (int l = 0; l < LMAX; l++) {
+            if (!(ena & (1 << l))) continue;
+            for (int k = 0; k < WIN_WORDS; k++) ppu->win_layers[l][k] |= in[w][k];
         }
     }
 }
@@ -509,7 +692,11 @@ void hmosaic_obj(PPU* ppu) {
     }
 }
 
-void compose_lines(PPU* ppu) {
+// the per pixel reference for compose_lines, ppubench -s checks the two
+// against each other on made up or captured lines
+void compose_lines_scalar(PPU* ppu) {
+    if (!host_lut_valid) build_host_lut();
+
     byte sorted_bgs[4];
     byte bg_prios[4];
     byte bgs = 0;
@@ -541,19 +728,16 @@ void compose_lines(PPU* ppu) {
     if (effect || ppu->obj_semitrans) {
         for (int x = 0; x < GBA_SCREEN_W; x++) {
             byte layers[6];
-            bool win_ena =
-                ppu->master->io.dispcnt.win_enable || ppu->master->io.dispcnt.winobj_enable;
-            byte win = ppu->window[x];
             int l = 0;
             bool put_obj = ppu->draw_obj && !(ppu->layerlines[LOBJ][x] & (1 << 15)) &&
-                           (!win_ena || (ppu->master->io.wincnt[win].obj_enable));
+                           win_on(ppu, LOBJ, x);
             for (int i = 0; i < bgs && l < 2; i++) {
                 if (put_obj && ppu->objdotattrs[x].priority <= bg_prios[i]) {
                     put_obj = false;
                     layers[l++] = LOBJ;
                 }
                 if (!(ppu->layerlines[sorted_bgs[i]][x] & (1 << 15)) &&
-                    (!win_ena || (ppu->master->io.wincnt[win].bg_enable & (1 << sorted_bgs[i])))) {
+                    win_on(ppu, sorted_bgs[i], x)) {
                     layers[l++] = sorted_bgs[i];
                 }
             }
@@ -579,9 +763,9 @@ void compose_lines(PPU* ppu) {
                 if (g1 > 31) g1 = 31;
                 b1 = (eva * b1 + evb * b2) / 16;
                 if (b1 > 31) b1 = 31;
-                ppu->screen[ppu->ly][x] = (b1 << 10) | (g1 << 5) | r1;
+                put_pixel(ppu, x, (b1 << 10) | (g1 << 5) | r1);
             } else if ((ppu->master->io.bldcnt.target1 & (1 << layers[0])) &&
-                       (!win_ena || ppu->master->io.wincnt[win].effects_enable)) {
+                       win_on(ppu, LBD, x)) {
                 byte r1 = color1 & 0x1f;
                 byte g1 = (color1 >> 5) & 0x1f;
                 byte b1 = (color1 >> 10) & 0x1f;
@@ -613,20 +797,17 @@ void compose_lines(PPU* ppu) {
                         break;
                     }
                 }
-                ppu->screen[ppu->ly][x] = (b1 << 10) | (g1 << 5) | r1;
+                put_pixel(ppu, x, (b1 << 10) | (g1 << 5) | r1);
             } else {
-                ppu->screen[ppu->ly][x] = color1;
+                put_pixel(ppu, x, color1);
             }
         }
     } else {
         for (int x = 0; x < GBA_SCREEN_W; x++) {
             byte layers[6];
-            bool win_ena =
-                ppu->master->io.dispcnt.win_enable || ppu->master->io.dispcnt.winobj_enable;
-            byte win = ppu->window[x];
             int l = 0;
             bool put_obj = ppu->draw_obj && !(ppu->layerlines[LOBJ][x] & (1 << 15)) &&
-                           (!win_ena || (ppu->master->io.wincnt[win].obj_enable));
+                           win_on(ppu, LOBJ, x);
 
             for (int i = 0; i < bgs; i++) {
                 if (put_obj && ppu->objdotattrs[x].priority <= bg_prios[i]) {
@@ -635,7 +816,7 @@ void compose_lines(PPU* ppu) {
                     break;
                 }
                 if (!(ppu->layerlines[sorted_bgs[i]][x] & (1 << 15)) &&
-                    (!win_ena || (ppu->master->io.wincnt[win].bg_enable & (1 << sorted_bgs[i])))) {
+                    win_on(ppu, sorted_bgs[i], x)) {
                     layers[l++] = sorted_bgs[i];
                     break;
                 }
@@ -645,12 +826,234 @@ void compose_lines(PPU* ppu) {
             }
             layers[l++] = LBD;
 
-            ppu->screen[ppu->ly][x] = ppu->layerlines[layers[0]][x];
+            put_pixel(ppu, x, ppu->layerlines[layers[0]][x]);
+        }
+    }
+}
+
+static const hvec lane_bits = {1, 2, 4, 8, 16, 32, 64, 128};
+
+#define VSEL(m, a, b) (((a) & (hvec) (m)) | ((b) & ~(hvec) (m)))
+#define VINSERT(m, c, id)                                                                          \
+    {                                                                                              \
+        mvec ins_top = (m) & ~has_top;                                                             \
+        mvec ins_sec = (m) & has_top & ~has_sec;                                                   \
+        top = VSEL(ins_top, c, top);                                                               \
+        top_id = VSEL(ins_top, id, top_id);                                                        \
+        sec = VSEL(ins_sec, c, sec);                                                               \
+        sec_id = VSEL(ins_sec, id, sec_id);                                                        \
+        has_top |= ins_top;                                                                        \
+        has_sec |= ins_sec;                                                                        \
+    }
+
+static inline hvec blend_alpha(hvec c1, hvec c2, hword eva, hword evb) {
+    hvec r = ((c1 & 0x1f) * eva + (c2 & 0x1f) * evb) >> 4;
+    hvec g = (((c1 >> 5) & 0x1f) * eva + ((c2 >> 5) & 0x1f) * evb) >> 4;
+    hvec b = (((c1 >> 10) & 0x1f) * eva + ((c2 >> 10) & 0x1f) * evb) >> 4;
+    r = VSEL(r > 31, (hvec){} + 31, r);
+    g = VSEL(g > 31, (hvec){} + 31, g);
+    b = VSEL(b > 31, (hvec){} + 31, b);
+    return b << 10 | g << 5 | r;
+}
+
+static inline hvec blend_bright(hvec c, hword evy, bool dec) {
+    hvec r = c & 0x1f;
+    hvec g = (c >> 5) & 0x1f;
+    hvec b = (c >> 10) & 0x1f;
+    if (dec) {
+        r -= (r * evy) >> 4;
+        g -= (g * evy) >> 4;
+        b -= (b * evy) >> 4;
+    } else {
+        r += ((31 - r) * evy) >> 4;
+        g += ((31 - g) * evy) >> 4;
+        b += ((31 - b) * evy) >> 4;
+    }
+    return b << 10 | g << 5 | r;
+}
+
+// same result as compose_lines_scalar, picks the top two layers for a
+// group of pixels at once with lane masks and blends them
+void compose_lines(PPU* ppu) {
+    if (!host_lut_valid) build_host_lut();
+
+    byte sorted_bgs[4];
+    byte bg_prios[4];
+    byte bgs = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!ppu->draw_bg[i]) continue;
+        sorted_bgs[bgs] = i;
+        bg_prios[bgs] = ppu->master->io.bgcnt[i].priority;
+        int j = bgs;
+        bgs++;
+        while (j > 0 && bg_prios[j] < bg_prios[j - 1]) {
+            byte tmp = sorted_bgs[j];
+            sorted_bgs[j] = sorted_bgs[j - 1];
+            sorted_bgs[j - 1] = tmp;
+            tmp = bg_prios[j];
+            bg_prios[j] = bg_prios[j - 1];
+            bg_prios[j - 1] = tmp;
+            j--;
+        }
+    }
+
+    byte effect = ppu->master->io.bldcnt.effect;
+    hword eva = ppu->master->io.bldalpha.eva;
+    hword evb = ppu->master->io.bldalpha.evb;
+    hword evy = ppu->master->io.bldy.evy;
+    if (eva > 16) eva = 16;
+    if (evb > 16) evb = 16;
+    if (evy > 16) evy = 16;
+    hword target1 = ppu->master->io.bldcnt.target1;
+    hword target2 = ppu->master->io.bldcnt.target2;
+    bool blend = effect || ppu->obj_semitrans;
+
+    hword prio_line[GBA_SCREEN_W];
+    hword semi_line[GBA_SCREEN_W];
+    for (int x = 0; x < GBA_SCREEN_W; x++) {
+        prio_line[x] = ppu->objdotattrs[x].priority;
+        semi_line[x] = ppu->objdotattrs[x].semitrans ? 0xffff : 0;
+    }
+
+    for (int x = 0; x < GBA_SCREEN_W; x += VLEN) {
+        hvec obj, obj_prio, obj_semi, bd;
+        memcpy(&obj, &ppu->layerlines[LOBJ][x], sizeof obj);
+        memcpy(&obj_prio, &prio_line[x], sizeof obj_prio);
+        memcpy(&obj_semi, &semi_line[x], sizeof obj_semi);
+        memcpy(&bd, &ppu->layerlines[LBD][x], sizeof bd);
+
+        // per dot layer enables: bits 0-3 bgs, 4 obj, 5 effects
+        hvec win = {};
+        for (int l = 0; l < LMAX; l++) {
+            hword bits = ppu->win_layers[l][x >> 6] >> (x & 63) & 0xff;
+            win |= (hvec) (((bits & lane_bits) != 0) & (shword) (1 << l));
         }
+
+        hvec top = {}, top_id = {}, sec = {}, sec_id = {};
+        mvec has_top = {}, has_sec = {};
+
+        mvec obj_pending = {};
+        if (ppu->draw_obj) obj_pending = ((obj & 1 << 15) == 0) & ((win & 1 << LOBJ) != 0);
+
+        for (int i = 0; i < bgs; i++) {
+            mvec put_obj = obj_pending & (obj_prio <= bg_prios[i]);
+            VINSERT(put_obj, obj, (hvec){} + (1 << LOBJ));
+            obj_pending &= ~put_obj;
+
+            int bg = sorted_bgs[i];
+            hword bg_bit = 1 << bg;
+            hvec c;
+            memcpy(&c, &ppu->layerlines[bg][x], sizeof c);
+            mvec put_bg = ((c & 1 << 15) == 0) & ((win & bg_bit) != 0);
+            VINSERT(put_bg, c, (hvec){} + bg_bit);
+        }
+        VINSERT(obj_pending, obj, (hvec){} + (1 << LOBJ));
+        VINSERT(~(mvec){}, bd, (hvec){} + (1 << LBD));
+
+        hvec out = top;
+        if (blend) {
+            mvec sec_t2 = (sec_id & target2) != 0;
+            mvec semi = (top_id == 1 << LOBJ) & (mvec) obj_semi & sec_t2;
+            mvec eff = ~semi & ((top_id & target1) != 0) & ((win & 1 << LBD) != 0);
+
+            hvec eff_out = top & 0x7fff;
+            switch (effect) {
+                case EFF_ALPHA:
+                    eff_out = VSEL(sec_t2, blend_alpha(top, sec, eva, evb), eff_out);
+                    break;
+                case EFF_BINC:
+                    eff_out = blend_bright(top, evy, false);
+                    break;
+                case EFF_BDEC:
+                    eff_out = blend_bright(top, evy, true);
+                    break;
+            }
+            out = VSEL(semi, blend_alpha(top, sec, eva, evb), out);
+            out = VSEL(eff, eff_out, out);
+        }
+        put_pixels(ppu, x, out);
+    }
+}
+
+void ppu_save_latch(PPU* ppu, LineLatch* l) {
+    l->bgaffintr[0] = ppu->bgaffintr[0];
+    l->bgaffintr[1] = ppu->bgaffintr[1];
+    l->bgmos_y = ppu->bgmos_y;
+    l->objmos_y = ppu->objmos_y;
+    l->in_win[0] = ppu->in_win[0];
+    l->in_win[1] = ppu->in_win[1];
+}
+
+void ppu_load_latch(PPU* ppu, LineLatch* l) {
+    ppu->bgaffintr[0] = l->bgaffintr[0];
+    ppu->bgaffintr[1] = l->bgaffintr[1];
+    ppu->bgmos_y = l->bgmos_y;
+    ppu->objmos_y = l->objmos_y;
+    ppu->in_win[0] = l->in_win[0];
+    ppu->in_win[1] = l->in_win[1];
+}
+
+// a visible line is only drawn again when something it reads differs from
+// the last time it was drawn: the display registers, the internal latches,
+// the memory generations, the obj dot attributes left by the line above
+// and the host format it was converted to
+static bool line_unchanged(PPU* ppu) {
+    PpuCache* c = &ppu->master->ppu_cache;
+    if (host_out) {
+        c->line_cache_valid[ppu->ly] = false;
+        return false;
+    }
+
+    IO* io = &ppu->master->io;
+    LineKey key;
+    memset(&key, 0, sizeof key);
+    memcpy(key.io, io->b, sizeof key.io);
+    memset(&key.io[DISPSTAT], 0, 4);
+    ppu_save_latch(ppu, &key.latch);
+    key.mem_gen[GEN_PRAM] = ppu->mem_gen[GEN_PRAM];
+    if (io->dispcnt.bg_enable) {
+        key.mem_gen[GEN_VRAM_BG] = ppu->mem_gen[GEN_VRAM_BG];
+        if (io->dispcnt.bg_mode >= 3) key.mem_gen[GEN_VRAM_OBJ] = ppu->mem_gen[GEN_VRAM_OBJ];
+    }
+    if (io->dispcnt.obj_enable) {
+        key.mem_gen[GEN_VRAM_OBJ] = ppu->mem_gen[GEN_VRAM_OBJ];
+        key.mem_gen[GEN_OAM] = ppu->mem_gen[GEN_OAM];
+        memcpy(key.objdotattrs, ppu->objdotattrs, sizeof key.objdotattrs);
+    }
+    key.pixfmt = host_pixfmt;
+    key.filter = host_filter;
+
+    LineKey* prev = &c->line_keys[ppu->ly];
+    if (c->line_cache_valid[ppu->ly] && !memcmp(prev, &key, sizeof key)) {
+        memcpy(ppu->objdotattrs, c->line_objdotattrs[ppu->ly], sizeof ppu->objdotattrs);
+        return true;
     }
+    *prev = key;
+    c->line_cache_valid[ppu->ly] = true;
+    return false;
+}
+
+void blank_scanline(PPU* ppu) {
+    memset(screen_row(ppu), 0xff, GBA_SCREEN_W * (host_pixfmt == PIXFMT_RGB565 ? 2 : 4));
+    ppu->master->ppu_cache.line_cache_valid[ppu->ly] = false;
+    ppu_stats.lines_drawn++;
+}
+
+// a skipped line leaves the screen alone but still runs the sprite pass,
+// since the obj dot attributes it leaves behind carry over to later lines
+void skip_scanline(PPU* ppu) {
+    if (ppu->master->io.dispcnt.forced_blank) return;
+    render_objs(ppu);
 }
 
 void draw_scanline(PPU* ppu) {
+    if (!host_lut_valid) build_host_lut();
+    if (line_unchanged(ppu)) {
+        ppu_stats.lines_reused++;
+        return;
+    }
+    ppu_stats.lines_drawn++;
+
     for (int x = 0; x < GBA_SCREEN_W; x++) {
         ppu->layerlines[LBD][x] = ppu->master->pram.h[0];
     }
@@ -663,8 +1066,7 @@ void draw_scanline(PPU* ppu) {
     ppu->obj_mos = false;
     ppu->obj_semitrans = false;
 
-    if (ppu->master->io.dispcnt.win_enable || ppu->master->io.dispcnt.winobj_enable)
-        memset(ppu->window, WOUT, GBA_SCREEN_W);
+    memset(ppu->objwin, 0, sizeof ppu->objwin);
     render_bgs(ppu);
     render_objs(ppu);
     render_windows(ppu);
@@ -676,6 +1078,37 @@ void draw_scanline(PPU* ppu) {
     if (ppu->obj_mos) hmosaic_obj(ppu);
 
     compose_lines(ppu);
+
+    memcpy(ppu->master->ppu_cache.line_objdotattrs[ppu->ly], ppu->objdotattrs,
+           sizeof ppu->objdotattrs);
+}
+
+// draws the lines latched since the last call. the bus calls this before
+// it changes anything they read, so drawing them late gives the same
+// result and a frame without mid frame changes is drawn in one go
+void ppu_catch_up(PPU* ppu) {
+    if (ppu->draw_ly == ppu->latch_ly) return;
+    PROF_ENTER(PROF_PPU);
+
+    byte ly = ppu->ly;
+    LineLatch cur;
+    ppu_save_latch(ppu, &cur);
+    for (; ppu->draw_ly < ppu->latch_ly; ppu->draw_ly++) {
+        ppu->ly = ppu->draw_ly;
+        ppu_load_latch(ppu, &ppu->line_latch[ppu->ly]);
+        if (ppu->skip_frame) {
+            skip_scanline(ppu);
+        } else if (ppu->master->io.dispcnt.forced_blank) {
+            blank_scanline(ppu);
+        } else if (replay_file) {
+            replay_draw_scanline(ppu);
+        } else {
+            draw_scanline(ppu);
+        }
+    }
+    ppu->ly = ly;
+    ppu_load_latch(ppu, &cur);
+    PROF_LEAVE();
 }
 
 void ppu_hdraw(PPU* ppu) {
@@ -693,10 +1126,13 @@ void ppu_hdraw(PPU* ppu) {
     } else ppu->master->io.dispstat.vcounteq = 0;
 
     if (ppu->ly == GBA_SCREEN_H) {
+        ppu_catch_up(ppu);
+        if (replay_file) replay_end_frame();
         ppu->master->io.dispstat.vblank = 1;
         ppu_vblank(ppu);
     } else if (ppu->ly == LINES_H - 1) {
         ppu->master->io.dispstat.vblank = 0;
+        if (ppu->threaded) ppu_thread_sync(ppu->master);
         ppu->frame_complete = true;
     }
 
@@ -713,11 +1149,14 @@ void ppu_hdraw(PPU* ppu) {
         }
     }
 
+    if (ppu->ly == 0) ppu->draw_ly = ppu->latch_ly = 0;
     if (ppu->ly < GBA_SCREEN_H) {
-        if (ppu->master->io.dispcnt.forced_blank) {
-            memset(&ppu->screen[ppu->ly][0], 0xff, sizeof ppu->screen[0]);
+        if (ppu->threaded) {
+            ppu_thread_line(ppu->master);
+            ppu->draw_ly = ppu->latch_ly = ppu->ly + 1;
         } else {
-            draw_scanline(ppu);
+            ppu_save_latch(ppu, &ppu->line_latch[ppu->ly]);
+            ppu->latch_ly = ppu->ly + 1;
         }
     }
 
@@ -1,6 +1,7 @@
 #ifndef PPU_H
 #define PPU_H
 
+#include "io.h"
 #include "types.h"
 
 #define GBA_SCREEN_W 240
@@ -61,16 +62,87 @@ typedef struct {
 } ObjAttr;
 
 enum { WIN0, WIN1, WOUT, WOBJ };
+
+#define WIN_WORDS ((GBA_SCREEN_W + 63) / 64)
 enum { LBG0, LBG1, LBG2, LBG3, LOBJ, LBD, LMAX };
 
 enum { EFF_NONE, EFF_ALPHA, EFF_BINC, EFF_BDEC };
 
+enum { PIXFMT_XRGB8888, PIXFMT_RGB565 };
+
+enum { GEN_VRAM_BG, GEN_VRAM_OBJ, GEN_PRAM, GEN_OAM, GEN_MAX };
+
+typedef struct {
+    dword lines_drawn;
+    dword lines_reused;
+} PpuStats;
+
+extern PpuStats ppu_stats;
+
+extern int host_pixfmt;
+extern bool host_filter;
+extern byte* host_out;
+extern word host_out_pitch;
+
+typedef struct {
+    sword x;
+    sword y;
+    sword mosx;
+    sword mosy;
+} BgAffLatch;
+
+// internal state a line is drawn with, latched at its hdraw
+typedef struct {
+    BgAffLatch bgaffintr[2];
+    byte bgmos_y;
+    byte objmos_y;
+    bool in_win[2];
+} LineLatch;
+
+// what a visible line was last drawn from
+typedef struct {
+    byte io[SOUND1CNT_L];
+    LineLatch latch;
+    word mem_gen[GEN_MAX];
+    byte objdotattrs[GBA_SCREEN_W];
+    byte pixfmt;
+    bool filter;
+} LineKey;
+
+#define TILE_SLOTS (0x18000 >> 5)
+
+// what the ppu derives from the state and draws for the host. it lives
+// outside the savestate part of the gba, gba_set_ptrs drops the caches
+// since they may not match whatever got loaded
+typedef struct {
+    // 4bpp tiles decoded to one byte per dot, indexed by 32 byte vram
+    // slot, slots are dropped when the bus writes to them
+    bool tile_cache_valid[TILE_SLOTS];
+    dword tile_cache[TILE_SLOTS][8];
+
+    // per visible line, a bitmask of the sprites whose y range covers it so
+    // iterating it keeps oam order. writes to attr0 or attr1 only mark the
+    // sprite, it is moved to its new lines before the next line is drawn
+    bool obj_lists_valid;
+    dword obj_list_dirty[2];
+    dword obj_lines[GBA_SCREEN_H][2];
+    byte obj_list_y[128];
+    byte obj_list_h[128];
+
+    // the screen lines and what they were drawn from, for skipping lines
+    // whose inputs are unchanged. host format pixels, rgb565 only fills
+    // the first half of each row
+    word screen[GBA_SCREEN_H][GBA_SCREEN_W];
+    bool line_cache_valid[GBA_SCREEN_H];
+    LineKey line_keys[GBA_SCREEN_H];
+    byte line_objdotattrs[GBA_SCREEN_H][GBA_SCREEN_W];
+} PpuCache;
+
 typedef struct _GBA GBA;
 
 typedef struct {
     GBA* master;
 
-    hword screen[GBA_SCREEN_H][GBA_SCREEN_W];
     byte ly;
 
     hword layerlines[LMAX][GBA_SCREEN_W];
@@ -80,14 +152,12 @@ typedef struct {
         byte mosaic : 1;
         byte pad : 4;
     } objdotattrs[GBA_SCREEN_W];
-    byte window[GBA_SCREEN_W];
+    // one bit per dot: the obj window, and for each layer the dots the
+    // windows let it show on, with the effects enable in the LBD slot
+    dword objwin[WIN_WORDS];
+    dword win_layers[LMAX][WIN_WORDS];
 
-    struct {
-        sword x;
-        sword y;
-        sword mosx;
-        sword mosy;
-    } bgaffintr[2];
+    BgAffLatch bgaffintr[2];
 
     byte bgmos_y;
     byte bgmos_ct;
@@ -103,14 +173,47 @@ typedef struct {
     int obj_cycles;
 
     bool frame_complete;
+
+    // lines up to latch_ly have had their hdraw but only those before
+    // draw_ly are drawn, the rest wait for ppu_catch_up
+    LineLatch line_latch[GBA_SCREEN_H];
+    byte draw_ly;
+    byte latch_ly;
+
+    // bumped whenever the contents of a memory region change
+    word mem_gen[GEN_MAX];
+
+    // draw lines on the render thread
+    bool threaded;
+    // keep every side effect of the frame but leave the screen as it is,
+    // only changed between frames
+    bool skip_frame;
 } PPU;
 
+void ppu_set_pixfmt(int fmt, bool filter);
+void ppu_set_output(void* buf, word pitch);
+void ppu_forget_lines(PPU* ppu);
+
+void ppu_invalidate_caches(GBA* gba);
+void ppu_tiles_dirty(GBA* gba, word addr, word len);
+void ppu_objs_dirty(GBA* gba, word addr, word len);
+
 void render_bgs(PPU* ppu);
 void render_objs(PPU* ppu);
 void render_windows(PPU* ppu);
 
+void compose_lines(PPU* ppu);
+void compose_lines_scalar(PPU* ppu);
+
+void ppu_save_latch(PPU* ppu, LineLatch* l);
+void ppu_load_latch(PPU* ppu, LineLatch* l);
+
+void blank_scanline(PPU* ppu);
+void skip_scanline(PPU* ppu);
 void draw_scanline(PPU* ppu);
 
+void ppu_catch_up(PPU* ppu);
+
 void ppu_hdraw(PPU* ppu);
 void ppu_vblank(PPU* ppu);
 void ppu_hblank(PPU* ppu);
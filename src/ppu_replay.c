@@ -0,0 +1,77 @@
+#include "ppu_replay.h"
+
+#include <string.h>
+
+#include "gba.h"
+
+FILE* replay_file;
+int replay_frames;
+word replay_gen[GEN_MAX];
+
+byte* replay_region(GBA* gba, int gen, word* size) {
+    switch (gen) {
+        case GEN_VRAM_BG:
+            *size = 0x10000;
+            return gba->vram.b;
+        case GEN_VRAM_OBJ:
+            *size = VRAM_SIZE - 0x10000;
+            return &gba->vram.b[0x10000];
+        case GEN_PRAM:
+            *size = PRAM_SIZE;
+            return gba->pram.b;
+        default:
+            *size = OAM_SIZE;
+            return gba->oam.b;
+    }
+}
+
+bool replay_capture_start(const char* filename, int frames) {
+    replay_capture_stop();
+    replay_file = fopen(filename, "wb");
+    if (!replay_file) return false;
+
+    ReplayHeader hdr = {.pixfmt = host_pixfmt, .filter = host_filter};
+    memcpy(hdr.magic, REPLAY_MAGIC, sizeof hdr.magic);
+    fwrite(&hdr, sizeof hdr, 1, replay_file);
+    replay_frames = frames;
+
+    // the first line drawn dumps every region
+    for (int i = 0; i < GEN_MAX; i++) replay_gen[i] = -1;
+    return true;
+}
+
+void replay_capture_stop() {
+    if (!replay_file) return;
+    fclose(replay_file);
+    replay_file = NULL;
+}
+
+// regions go out whole whenever their generation moved since the last line
+void replay_draw_scanline(PPU* ppu) {
+    for (int i = 0; i < GEN_MAX; i++) {
+        if (ppu->mem_gen[i] == replay_gen[i]) continue;
+        replay_gen[i] = ppu->mem_gen[i];
+        word size;
+        byte* mem = replay_region(ppu->master, i, &size);
+        fputc(REPLAY_MEM, replay_file);
+        fputc(i, replay_file);
+        fwrite(mem, size, 1, replay_file);
+    }
+
+    ReplayLine line = {.ly = ppu->ly};
+    memcpy(line.io, ppu->master->io.b, sizeof line.io);
+    ppu_save_latch(ppu, &line.latch);
+    memcpy(line.objdotattrs, ppu->objdotattrs, sizeof line.objdotattrs);
+
+    draw_scanline(ppu);
+
+    byte* row = host_out ? host_out + ppu->ly * host_out_pitch
+                         : (byte*) ppu->master->ppu_cache.screen[ppu->ly];
+    memcpy(line.out, row, GBA_SCREEN_W * (host_pixfmt == PIXFMT_RGB565 ? 2 : 4));
+    fputc(REPLAY_LINE, replay_file);
+    fwrite(&line, sizeof line, 1, replay_file);
+}
+
+void replay_end_frame() {
+    if (--replay_frames <= 0) replay_capture_stop();
+}
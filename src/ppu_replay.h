@@ -0,0 +1,42 @@
+#ifndef PPU_REPLAY_H
+#define PPU_REPLAY_H
+
+#include <stdio.h>
+
+#include "io.h"
+#include "ppu.h"
+#include "types.h"
+
+// a capture holds everything the lines drawn over a number of frames
+// read, so the renderer can be run again and checked without the cpu.
+// it is a header followed by records, each a type byte and its body:
+// a line with its output, or the new contents of a memory region
+#define REPLAY_MAGIC "agbppu01"
+
+enum { REPLAY_LINE, REPLAY_MEM };
+
+typedef struct {
+    char magic[8];
+    byte pixfmt;
+    bool filter;
+} ReplayHeader;
+
+typedef struct {
+    byte ly;
+    byte io[SOUND1CNT_L];
+    LineLatch latch;
+    byte objdotattrs[GBA_SCREEN_W];
+    word out[GBA_SCREEN_W];
+} ReplayLine;
+
+extern FILE* replay_file;
+
+byte* replay_region(GBA* gba, int gen, word* size);
+
+bool replay_capture_start(const char* filename, int frames);
+void replay_capture_stop();
+
+void replay_draw_scanline(PPU* ppu);
+void replay_end_frame();
+
+#endif
@@ -0,0 +1,173 @@
+#include "ppu_thread.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// at each hdraw the emulation thread queues the display registers, the
+// internal affine and mosaic latches and the chunks of vram, pram and oam
+// written since the previous line. the render thread applies them to a
+// shadow gba and draws into its screen, which is copied out at the end
+// of the frame unless lines already go straight to a frontend buffer
+
+pthread_t ppu_worker;
+pthread_mutex_t ppu_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t ppu_cond = PTHREAD_COND_INITIALIZER;
+bool ppu_running;
+bool ppu_quit;
+
+GBA* ppu_shadow;
+
+PpuJob ppu_jobs[PPU_JOBS];
+int ppu_job_head;
+int ppu_job_tail;
+
+bool ppu_dirty[PPU_CHUNKS];
+
+static byte* mem_ptr(GBA* gba, word addr) {
+    if (addr < PPU_MEM_PRAM) return &gba->vram.b[addr];
+    if (addr < PPU_MEM_OAM) return &gba->pram.b[addr - PPU_MEM_PRAM];
+    return &gba->oam.b[addr - PPU_MEM_OAM];
+}
+
+static void run_job(PpuJob* job) {
+    GBA* gba = ppu_shadow;
+    for (int i = 0; i < job->n_chunks; i++) {
+        word addr = job->chunk_ind[i] << PPU_CHUNK_SHIFT;
+        if (!memcmp(mem_ptr(gba, addr), job->chunks[i], PPU_CHUNK_SIZE)) continue;
+        memcpy(mem_ptr(gba, addr), job->chunks[i], PPU_CHUNK_SIZE);
+        gba->ppu.mem_gen[addr < PPU_MEM_VRAM + 0x10000 ? GEN_VRAM_BG
+                         : addr < PPU_MEM_PRAM       ? GEN_VRAM_OBJ
+                         : addr < PPU_MEM_OAM        ? GEN_PRAM
+                                                     : GEN_OAM]++;
+        if (addr < PPU_MEM_PRAM) ppu_tiles_dirty(gba, addr, PPU_CHUNK_SIZE);
+        if (addr >= PPU_MEM_OAM) ppu_objs_dirty(gba, addr - PPU_MEM_OAM, PPU_CHUNK_SIZE);
+    }
+    memcpy(gba->io.b, job->io, sizeof job->io);
+    gba->ppu.ly = job->ly;
+    ppu_load_latch(&gba->ppu, &job->latch);
+
+    if (job->skip) {
+        skip_scanline(&gba->ppu);
+    } else if (gba->io.dispcnt.forced_blank) {
+        blank_scanline(&gba->ppu);
+    } else {
+        draw_scanline(&gba->ppu);
+    }
+}
+
+static void* ppu_worker_run(void* arg) {
+    pthread_mutex_lock(&ppu_lock);
+    while (true) {
+        while (ppu_job_head == ppu_job_tail && !ppu_quit) pthread_cond_wait(&ppu_cond, &ppu_lock);
+        if (ppu_quit) break;
+        PpuJob* job = &ppu_jobs[ppu_job_head % PPU_JOBS];
+        pthread_mutex_unlock(&ppu_lock);
+
+        run_job(job);
+
+        pthread_mutex_lock(&ppu_lock);
+        ppu_job_head++;
+        pthread_cond_broadcast(&ppu_cond);
+    }
+    pthread_mutex_unlock(&ppu_lock);
+    return NULL;
+}
+
+static void wait_idle() {
+    while (ppu_job_head != ppu_job_tail) pthread_cond_wait(&ppu_cond, &ppu_lock);
+}
+
+void ppu_thread_start(GBA* gba) {
+    if (!ppu_shadow) ppu_shadow = calloc(1, sizeof *ppu_shadow);
+    if (!ppu_running) {
+        ppu_running = true;
+        pthread_create(&ppu_worker, NULL, ppu_worker_run, NULL);
+    }
+
+    ppu_catch_up(&gba->ppu);
+
+    pthread_mutex_lock(&ppu_lock);
+    wait_idle();
+    ppu_shadow->io = gba->io;
+    ppu_shadow->ppu = gba->ppu;
+    ppu_shadow->pram = gba->pram;
+    ppu_shadow->vram = gba->vram;
+    ppu_shadow->oam = gba->oam;
+    gba_set_ptrs(ppu_shadow, NULL, NULL);
+    ppu_shadow->ppu.threaded = false;
+    memset(ppu_dirty, 0, sizeof ppu_dirty);
+    pthread_mutex_unlock(&ppu_lock);
+
+    // the screen gets the shadow's lines from now on
+    ppu_forget_lines(&gba->ppu);
+
+    gba->ppu.threaded = true;
+}
+
+void ppu_thread_stop(GBA* gba) {
+    gba->ppu.threaded = false;
+    if (!ppu_running) return;
+
+    pthread_mutex_lock(&ppu_lock);
+    wait_idle();
+    ppu_quit = true;
+    pthread_cond_broadcast(&ppu_cond);
+    pthread_mutex_unlock(&ppu_lock);
+    pthread_join(ppu_worker, NULL);
+
+    ppu_running = false;
+    ppu_quit = false;
+}
+
+// returns once every queued line is drawn, nothing is queued again until
+// the emulation thread runs, so what the lines are drawn with can change
+void ppu_thread_wait() {
+    if (!ppu_running) return;
+
+    pthread_mutex_lock(&ppu_lock);
+    wait_idle();
+    pthread_mutex_unlock(&ppu_lock);
+}
+
+void ppu_thread_dirty(word addr) {
+    ppu_dirty[addr >> PPU_CHUNK_SHIFT] = true;
+}
+
+void ppu_thread_line(GBA* gba) {
+    if (!ppu_running) return;
+
+    pthread_mutex_lock(&ppu_lock);
+    while (ppu_job_tail - ppu_job_head == PPU_JOBS) pthread_cond_wait(&ppu_cond, &ppu_lock);
+    PpuJob* job = &ppu_jobs[ppu_job_tail % PPU_JOBS];
+    pthread_mutex_unlock(&ppu_lock);
+
+    job->ly = gba->ppu.ly;
+    job->skip = gba->ppu.skip_frame;
+    memcpy(job->io, gba->io.b, sizeof job->io);
+    ppu_save_latch(&gba->ppu, &job->latch);
+
+    job->n_chunks = 0;
+    for (int i = 0; i < PPU_CHUNKS; i++) {
+        if (!ppu_dirty[i]) continue;
+        ppu_dirty[i] = false;
+        job->chunk_ind[job->n_chunks] = i;
+        memcpy(job->chunks[job->n_chunks++], mem_ptr(gba, i << PPU_CHUNK_SHIFT), PPU_CHUNK_SIZE);
+    }
+
+    pthread_mutex_lock(&ppu_lock);
+    ppu_job_tail++;
+    pthread_cond_broadcast(&ppu_cond);
+    pthread_mutex_unlock(&ppu_lock);
+}
+
+void ppu_thread_sync(GBA* gba) {
+    if (!ppu_running) return;
+
+    pthread_mutex_lock(&ppu_lock);
+    wait_idle();
+    if (!host_out) {
+        memcpy(gba->ppu_cache.screen, ppu_shadow->ppu_cache.screen, sizeof gba->ppu_cache.screen);
+    }
+    pthread_mutex_unlock(&ppu_lock);
+}
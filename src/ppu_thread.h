@@ -0,0 +1,41 @@
+#ifndef PPU_THREAD_H
+#define PPU_THREAD_H
+
+#include "gba.h"
+#include "io.h"
+#include "ppu.h"
+#include "types.h"
+
+// vram, pram and oam are tracked as one space split into chunks
+#define PPU_MEM_VRAM 0
+#define PPU_MEM_PRAM VRAM_SIZE
+#define PPU_MEM_OAM (VRAM_SIZE + PRAM_SIZE)
+#define PPU_MEM_SIZE (VRAM_SIZE + PRAM_SIZE + OAM_SIZE)
+
+#define PPU_CHUNK_SHIFT 9
+#define PPU_CHUNK_SIZE (1 << PPU_CHUNK_SHIFT)
+#define PPU_CHUNKS (PPU_MEM_SIZE >> PPU_CHUNK_SHIFT)
+
+#define PPU_JOBS 8
+
+typedef struct {
+    byte ly;
+    bool skip;
+    byte io[SOUND1CNT_L];
+    LineLatch latch;
+
+    int n_chunks;
+    hword chunk_ind[PPU_CHUNKS];
+    byte chunks[PPU_CHUNKS][PPU_CHUNK_SIZE];
+} PpuJob;
+
+void ppu_thread_start(GBA* gba);
+void ppu_thread_stop(GBA* gba);
+void ppu_thread_wait();
+
+void ppu_thread_dirty(word addr);
+
+void ppu_thread_line(GBA* gba);
+void ppu_thread_sync(GBA* gba);
+
+#endif
@@ -7,6 +7,10 @@
 #include "ppu.h"
 #include "timer.h"
 
+#ifdef AGBEMU_PROF
+volatile sig_atomic_t prof_zone;
+#endif
+
 void (*apu_events[])(APU*) = {apu_new_sample, ch1_reload, ch2_reload,
                               ch3_reload,     ch4_reload, apu_div_tick};
 
@@ -40,6 +44,7 @@ void run_scheduler_internal(Scheduler* sched, int cycles) {
 
 int run_next_event(Scheduler* sched) {
     if (sched->n_events == 0) return 0;
+    PROF_ENTER(PROF_SCHED);
 
     Event e = sched->event_queue[0];
     sched->n_events--;
@@ -66,8 +71,10 @@ int run_next_event(Scheduler* sched) {
     } else if (e.type == EVENT_PPU_HBLANK) {
         ppu_hblank(&sched->master->ppu);
     } else {
+        PROF_SET(PROF_APU);
         apu_events[e.type - EVENT_APU_SAMPLE](&sched->master->apu);
     }
+    PROF_LEAVE();
     return sched->now - e.time;
 }
 
@@ -44,6 +44,27 @@ typedef struct {
     EventType type;
 } Event;
 
+// what the emulation thread is busy with, for a sampling profiler to
+// read from a signal handler. the cpu is running unless another is set.
+// only tracked in builds with AGBEMU_PROF, like the one make bench does
+typedef enum { PROF_CPU, PROF_PPU, PROF_APU, PROF_DMA, PROF_SCHED, PROF_MAX } ProfZone;
+
+#ifdef AGBEMU_PROF
+#include <signal.h>
+
+extern volatile sig_atomic_t prof_zone;
+
+#define PROF_ENTER(z)                                                                              \
+    sig_atomic_t prof_prev = prof_zone;                                                            \
+    prof_zone = z
+#define PROF_SET(z) prof_zone = z
+#define PROF_LEAVE() prof_zone = prof_prev
+#else
+#define PROF_ENTER(z)
+#define PROF_SET(z)
+#define PROF_LEAVE()
+#endif
+
 typedef struct _GBA GBA;
 
 typedef struct {
@@ -64,16 +64,14 @@ void reload_timer(TimerController* tmc, int i) {
     update_timer_reload(tmc, i);
 
     if (tmc->master->io.soundcnth.cha_timer == i) {
-        fifo_a_pop(&tmc->master->apu);
-        if (tmc->master->apu.fifo_a_size <= 16 &&
+        if (fifo_a_pop(&tmc->master->apu) &&
             tmc->master->io.dma[1].cnt.start == DMA_ST_SPEC) {
             tmc->master->dmac.dma[1].sound = true;
             dma_activate(&tmc->master->dmac, 1);
         }
     }
     if (tmc->master->io.soundcnth.chb_timer == i) {
-        fifo_b_pop(&tmc->master->apu);
-        if (tmc->master->apu.fifo_b_size <= 16 &&
+        if (fifo_b_pop(&tmc->master->apu) &&
             tmc->master->io.dma[2].cnt.start == DMA_ST_SPEC) {
             tmc->master->dmac.dma[2].sound = true;
             dma_activate(&tmc->master->dmac, 2);
@@ -0,0 +1,247 @@
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "arm_isa.h"
+#include "gba.h"
+#include "thumb_isa.h"
+
+// runs each rom for a fixed number of frames on a blank bios, the same
+// way agbemu-headless does, and reports the wall time and how it split
+// between the subsystems. the split comes from sampling prof_zone on a
+// wall clock timer, so the emulator only pays a store when it moves from
+// one subsystem to another. everything runs on one thread for the zone to
+// be right. results are printed as json, one rom per line, and a file
+// saved from an earlier run can be given to compare against
+
+static const char usage[] = "agbemu-bench [options] <romfile>...\n"
+                            "-c <frames> -- frames to run each rom for (default 600)\n"
+                            "-r <runs> -- runs of each rom, the fastest is kept (default 1)\n"
+                            "-o <file> -- write the results here instead of stdout\n"
+                            "-B <file> -- compare against an earlier run, failing on changed states\n"
+                            "-t <percent> -- fail if any rom got this much slower (default 5)\n";
+
+#define SAMPLE_USEC 100
+#define ROMS_MAX 64
+
+static const char* zone_names[PROF_MAX] = {"cpu", "ppu", "apu", "dma", "sched"};
+
+typedef struct {
+    char name[64];
+    double secs;
+    dword samples[PROF_MAX];
+    dword state;
+} Result;
+
+char* romfiles[ROMS_MAX];
+int n_roms;
+
+char* outfile;
+char* basefile;
+int frames = 600;
+int runs = 1;
+double threshold = 5;
+
+volatile dword samples[PROF_MAX];
+
+static bool read_bench_args(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            if (n_roms == ROMS_MAX) return false;
+            romfiles[n_roms++] = argv[i];
+            continue;
+        }
+        char* val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!val) return false;
+        switch (argv[i][1]) {
+            case 'c':
+                frames = atoi(val);
+                break;
+            case 'r':
+                runs = atoi(val);
+                break;
+            case 'o':
+                outfile = val;
+                break;
+            case 'B':
+                basefile = val;
+                break;
+            case 't':
+                threshold = atof(val);
+                break;
+            default:
+                printf("Invalid flag\n");
+                return false;
+        }
+        i++;
+    }
+    return n_roms && frames > 0 && runs > 0;
+}
+
+static void take_sample(int sig) {
+    samples[prof_zone]++;
+}
+
+static void set_sampling(bool on) {
+    struct itimerval t = {0};
+    if (on) {
+        t.it_interval.tv_usec = SAMPLE_USEC;
+        t.it_value.tv_usec = SAMPLE_USEC;
+    }
+    setitimer(ITIMER_REAL, &t, NULL);
+}
+
+// the file name without its directory or extension
+static void rom_name(const char* romfile, char* name, int len) {
+    const char* base = strrchr(romfile, '/');
+    base = base ? base + 1 : romfile;
+    snprintf(name, len, "%s", base);
+    char* ext = strrchr(name, '.');
+    if (ext && ext != name) *ext = '\0';
+}
+
+static void run_rom(GBA* gba, Cartridge* cart, byte* bios, Result* res) {
+    init_gba(gba, cart, bios, false);
+    memset((void*) samples, 0, sizeof samples);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    set_sampling(true);
+
+    for (int f = 0; f < frames; f++) {
+        while (!gba->stop && !gba->ppu.frame_complete) {
+            gba_step(gba);
+            gba->apu.samples_full = false;
+        }
+        gba->ppu.frame_complete = false;
+    }
+
+    set_sampling(false);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    res->secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    memcpy(res->samples, (void*) samples, sizeof res->samples);
+    // the state agbemu-headless prints, a change means the rom did
+    // different work and its times can't be compared
+    res->state = gba_hash_state(gba);
+}
+
+static void write_results(FILE* fp, Result* results) {
+    fprintf(fp, "{\n  \"frames\": %d,\n  \"results\": [\n", frames);
+    for (int i = 0; i < n_roms; i++) {
+        Result* r = &results[i];
+        dword total = 0;
+        for (int z = 0; z < PROF_MAX; z++) total += r->samples[z];
+        fprintf(fp, "    {\"name\": \"%s\", \"seconds\": %.4f, \"fps\": %.2f, ", r->name, r->secs,
+                frames / r->secs);
+        fprintf(fp, "\"state\": \"%016lx\", ", r->state);
+        fprintf(fp, "\"share\": {");
+        for (int z = 0; z < PROF_MAX; z++) {
+            fprintf(fp, "%s\"%s\": %.4f", z ? ", " : "", zone_names[z],
+                    total ? (double) r->samples[z] / total : 0);
+        }
+        fprintf(fp, "}}%s\n", i + 1 < n_roms ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+// reads back what write_results wrote, a rom to a line
+static int read_results(const char* filename, Result* results) {
+    FILE* fp = fopen(filename, "r");
+    if (!fp) return -1;
+    int n = 0;
+    char line[1024];
+    while (n < ROMS_MAX && fgets(line, sizeof line, fp)) {
+        Result* r = &results[n];
+        char* name = strstr(line, "\"name\": ");
+        char* secs = strstr(line, "\"seconds\": ");
+        char* state = strstr(line, "\"state\": ");
+        if (!name || !secs || !state) continue;
+        if (sscanf(name, "\"name\": \"%63[^\"]\"", r->name) == 1 &&
+            sscanf(secs, "\"seconds\": %lf", &r->secs) == 1 &&
+            sscanf(state, "\"state\": \"%lx\"", &r->state) == 1)
+            n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+// prints how each rom did against the baseline, returns whether any got
+// slower than the threshold or ended on a different state. a different
+// state means the emulator now does something else, not just faster
+static bool compare_results(Result* results, Result* base, int n_base) {
+    bool failed = false;
+    fprintf(stderr, "%-16s %10s %10s %9s\n", "rom", "base s", "now s", "change");
+    for (int i = 0; i < n_roms; i++) {
+        Result* r = &results[i];
+        Result* b = NULL;
+        for (int j = 0; j < n_base; j++) {
+            if (!strcmp(base[j].name, r->name)) b = &base[j];
+        }
+        if (!b) {
+            fprintf(stderr, "%-16s %10s %10.4f\n", r->name, "-", r->secs);
+            continue;
+        }
+        double change = (r->secs / b->secs - 1) * 100;
+        fprintf(stderr, "%-16s %10.4f %10.4f %+8.1f%%%s\n", r->name, b->secs, r->secs, change,
+                r->state != b->state ? "  (state differs)" : "");
+        if (change > threshold || r->state != b->state) failed = true;
+    }
+    return failed;
+}
+
+int main(int argc, char** argv) {
+    if (!read_bench_args(argc, argv)) {
+        printf(usage);
+        return -1;
+    }
+
+    static Result base[ROMS_MAX];
+    int n_base = 0;
+    if (basefile && (n_base = read_results(basefile, base)) < 0) {
+        printf("Invalid baseline file\n");
+        return -1;
+    }
+
+    signal(SIGALRM, take_sample);
+    arm_generate_lookup();
+    thumb_generate_lookup();
+
+    GBA* gba = malloc(sizeof *gba);
+    byte* bios = calloc(BIOS_SIZE, 1);
+    static Result results[ROMS_MAX];
+
+    for (int i = 0; i < n_roms; i++) {
+        Cartridge* cart = create_cartridge(romfiles[i]);
+        if (!cart) {
+            printf("Invalid rom file %s\n", romfiles[i]);
+            return -1;
+        }
+        if (cart->sav_size) memset(cart->sram, 0xff, cart->sav_size);
+
+        Result* res = &results[i];
+        for (int run = 0; run < runs; run++) {
+            Result cur;
+            run_rom(gba, cart, bios, &cur);
+            if (run == 0 || cur.secs < res->secs) *res = cur;
+        }
+        rom_name(romfiles[i], res->name, sizeof res->name);
+    }
+
+    FILE* fp = outfile ? fopen(outfile, "w") : stdout;
+    if (!fp) {
+        printf("Could not open %s\n", outfile);
+        return -1;
+    }
+    write_results(fp, results);
+    if (fp != stdout) fclose(fp);
+
+    bool failed = basefile && compare_results(results, base, n_base);
+
+    free(bios);
+    free(gba);
+    return failed ? 1 : 0;
+}
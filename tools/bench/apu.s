@@ -0,0 +1,91 @@
+@ audio heavy: both direct sound fifos are fed by dma from two fast
+@ timers while the four psg channels play, retriggered with new settings
+@ every few frames. the display is blanked
+.include "common.inc"
+start:
+  ldr r7, =0x04000100
+  ldr r10, =0x1B873593
+  mov r0, #0x02000000
+  ldr r1, =0x4000
+  fill_rand
+  mov r0, #0x04000000
+  mov r1, #0x80
+  strh r1, [r0]
+  strh r1, [r0, #0x84]
+  ldr r1, =0xff77
+  strh r1, [r0, #0x80]
+  ldr r1, =0x730e
+  strh r1, [r0, #0x82]
+  ldr r1, =0xff00
+  strh r1, [r7, #0x00]
+  mov r1, #0x80
+  strh r1, [r7, #0x02]
+  ldr r1, =0xfe00
+  strh r1, [r7, #0x04]
+  mov r1, #0x80
+  strh r1, [r7, #0x06]
+  mov r9, #0
+frame:
+  wait_vblank
+  add r9, r9, #1
+  mov r0, #0x04000000
+  @ restart the fifo streams at the top of the buffer
+  mov r1, #0
+  strh r1, [r0, #0xc6]
+  strh r1, [r0, #0xd2]
+  ldr r1, =0x02000000
+  str r1, [r0, #0xbc]
+  ldr r1, =0x040000a0
+  str r1, [r0, #0xc0]
+  ldr r1, =0xb640
+  strh r1, [r0, #0xc6]
+  ldr r1, =0x02008000
+  str r1, [r0, #0xc8]
+  ldr r1, =0x040000a4
+  str r1, [r0, #0xcc]
+  ldr r1, =0xb640
+  strh r1, [r0, #0xd2]
+  tst r9, #7
+  bne frame
+  @ new wave and retriggered psg channels
+  mov r1, #0x40
+  strh r1, [r0, #0x70]
+  rnd
+  str r10, [r0, #0x90]
+  rnd
+  str r10, [r0, #0x94]
+  rnd
+  str r10, [r0, #0x98]
+  rnd
+  str r10, [r0, #0x9c]
+  mov r1, #0x80
+  strh r1, [r0, #0x70]
+  mov r1, #0x23
+  strh r1, [r0, #0x60]
+  ldr r1, =0xf780
+  strh r1, [r0, #0x62]
+  rnd
+  ldr r2, =0x7ff
+  and r1, r10, r2
+  orr r1, r1, #0x8000
+  strh r1, [r0, #0x64]
+  ldr r1, =0xf740
+  strh r1, [r0, #0x68]
+  lsr r1, r10, #11
+  and r1, r1, r2
+  orr r1, r1, #0x8000
+  strh r1, [r0, #0x6c]
+  ldr r1, =0x2000
+  strh r1, [r0, #0x72]
+  lsr r1, r10, #7
+  and r1, r1, r2
+  orr r1, r1, #0x8000
+  strh r1, [r0, #0x74]
+  ldr r1, =0xf700
+  strh r1, [r0, #0x78]
+  lsr r1, r10, #20
+  and r1, r1, #0xff
+  orr r1, r1, #0x8000
+  strh r1, [r0, #0x7c]
+  b frame
+.ltorg
@@ -0,0 +1,77 @@
+@ cpu bound: the display is blanked and nothing else is running, so the
+@ time goes to arm code run from rom and iwram and thumb code from rom
+.include "common.inc"
+start:
+  mov r0, #0x04000000
+  mov r1, #0x80
+  strh r1, [r0]
+  ldr r0, =iwram_loop
+  ldr r1, =0x03000000
+  ldr r2, =iwram_loop_end
+1: ldr r3, [r0], #4
+  str r3, [r1], #4
+  cmp r0, r2
+  blo 1b
+  ldr r10, =0x9E3779B9
+  mov r11, #0
+main:
+  ldr r0, =table
+  mov r1, #256
+  mov r2, #0
+2: ldr r3, [r0], #4
+  mla r2, r3, r10, r2
+  eor r10, r10, r2, ror #7
+  subs r1, r1, #1
+  bne 2b
+  ldr r4, =0x03000000
+  mov lr, pc
+  bx r4
+  ldr r4, =thumb_loop + 1
+  mov lr, pc
+  bx r4
+  b main
+.ltorg
+
+@ copied to iwram, so it takes no literals
+iwram_loop:
+  mov r0, #0x03000000
+  orr r0, r0, #0x1000
+  mov r1, #128
+3: rnd
+  umull r2, r3, r10, r10
+  stmia r0!, {r2, r3, r10}
+  ldmdb r0, {r4, r5, r6}
+  adds r2, r4, r5
+  addcs r11, r11, #1
+  tst r6, #1
+  subne r11, r11, r6, lsr #3
+  subs r1, r1, #1
+  bne 3b
+  bx lr
+iwram_loop_end:
+
+.thumb
+.align 2
+thumb_loop:
+  push {r4, r5}
+  ldr r0, =0x03002000
+  movs r1, #200
+4: lsls r2, r1, #2
+  ldr r3, [r0, r2]
+  adds r3, r3, r1
+  muls r3, r1, r3
+  str r3, [r0, r2]
+  lsrs r4, r3, #3
+  eors r5, r4
+  subs r1, #1
+  bne 4b
+  pop {r4, r5}
+  bx lr
+.ltorg
+
+.arm
+.align 2
+table:
+.rept 64
+.word 0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344
+.endr
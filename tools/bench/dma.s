@@ -0,0 +1,59 @@
+@ dma heavy: every vblank dma3 uploads tiles, maps, sprites and palettes
+@ from rom and ewram in word and halfword units, including a fill, while
+@ an hblank dma scrolls the one background shown line by line
+.include "common.inc"
+.macro dma3 sad, dad, ct, cnth
+  ldr r1, =\sad
+  str r1, [r0, #0xd4]
+  ldr r1, =\dad
+  str r1, [r0, #0xd8]
+  ldr r1, =\ct
+  strh r1, [r0, #0xdc]
+  ldr r1, =\cnth
+  strh r1, [r0, #0xde]
+  nop
+  nop
+.endm
+start:
+  ldr r10, =0x68E31DA4
+  mov r0, #0x02000000
+  ldr r1, =0x8000
+  fill_rand
+  mov r0, #0x04000000
+  mov r1, #0x0100
+  strh r1, [r0]
+  ldr r1, =0x1f00
+  strh r1, [r0, #0x08]
+  mov r9, #0
+frame:
+  wait_vblank
+  add r9, r9, #1
+  mov r0, #0x04000000
+  @ rearm the hblank scroll from the start of its table
+  mov r1, #0
+  strh r1, [r0, #0xba]
+  ldr r1, =0x02000000
+  add r1, r1, r9, lsl #2
+  str r1, [r0, #0xb0]
+  ldr r1, =0x04000010
+  str r1, [r0, #0xb4]
+  mov r1, #1
+  strh r1, [r0, #0xb8]
+  ldr r1, =0xa240
+  strh r1, [r0, #0xba]
+  dma3 rom_data, 0x06000000, 0x1000, 0x8400
+  dma3 0x02008000, 0x06004000, 0x0800, 0x8400
+  dma3 0x02010000, 0x0600f800, 0x0400, 0x8000
+  dma3 0x02000100, 0x07000000, 0x0100, 0x8400
+  dma3 0x02001000, 0x05000000, 0x0200, 0x8000
+  dma3 0x02000000, 0x06008000, 0x1000, 0x8100
+  dma3 0x02000000, 0x02020000, 0x2000, 0x8000
+  dma3 rom_data, 0x02030000, 0x1000, 0x8400
+  b frame
+.ltorg
+
+.align 12
+rom_data:
+.rept 0x1000
+.word 0x9E3779B9, 0x7F4A7C15, 0xF39CC060, 0x5CEDC834
+.endr
@@ -0,0 +1,96 @@
+@ ppu heavy: two affine backgrounds under 128 large sprites, half of them
+@ affine and double sized, with alpha blending and a window. every 128
+@ frames it switches between mode 2 and mode 1, which adds two text
+@ backgrounds. sprites and matrices move every frame
+.include "common.inc"
+start:
+  ldr r10, =0x2545F491
+  mov r0, #0x06000000
+  ldr r1, =0x6000
+  fill_rand
+  mov r0, #0x05000000
+  mov r1, #0x100
+  fill_rand
+  mov r0, #0x04000000
+  ldr r1, =0x6800
+  strh r1, [r0, #0x08]
+  ldr r1, =0x7401
+  strh r1, [r0, #0x0a]
+  ldr r1, =0x7002
+  strh r1, [r0, #0x0c]
+  ldr r1, =0x5403
+  strh r1, [r0, #0x0e]
+  ldr r1, =0x14dc
+  strh r1, [r0, #0x40]
+  ldr r1, =0x0a96
+  strh r1, [r0, #0x44]
+  mov r1, #0x3f
+  strh r1, [r0, #0x48]
+  mov r1, #0x17
+  strh r1, [r0, #0x4a]
+  ldr r1, =0x2854
+  strh r1, [r0, #0x50]
+  ldr r1, =0x0a08
+  strh r1, [r0, #0x52]
+  mov r9, #0
+frame:
+  wait_vblank
+  add r9, r9, #1
+  mov r0, #0x04000000
+  tst r9, #0x80
+  ldr r1, =0x3f40
+  orreq r1, r1, #2
+  orrne r1, r1, #1
+  strh r1, [r0]
+  @ background matrices and origins follow the frame count
+  and r2, r9, #0x3f
+  add r1, r2, #0x100
+  strh r1, [r0, #0x20]
+  strh r2, [r0, #0x22]
+  rsb r1, r2, #0
+  strh r1, [r0, #0x24]
+  add r1, r2, #0xc0
+  strh r1, [r0, #0x26]
+  lsl r1, r9, #8
+  str r1, [r0, #0x28]
+  str r1, [r0, #0x2c]
+  sub r1, r2, #0x180
+  strh r1, [r0, #0x30]
+  strh r2, [r0, #0x32]
+  strh r2, [r0, #0x34]
+  add r1, r2, #0x80
+  strh r1, [r0, #0x36]
+  rsb r1, r1, #0
+  str r1, [r0, #0x38]
+  lsl r1, r9, #9
+  str r1, [r0, #0x3c]
+  @ every sprite gets a new place and tile, every matrix new scales
+  mov r0, #0x07000000
+  mov r3, #0
+4: rnd
+  and r1, r10, #0xff
+  tst r3, #1
+  orreq r1, r1, #0x300
+  tst r3, #2
+  orrne r1, r1, #0x400
+  strh r1, [r0, #0]
+  lsr r1, r10, #8
+  ldr r2, =0x1ff
+  and r1, r1, r2
+  orr r1, r1, #0x8000
+  and r2, r3, #0x3e
+  orr r1, r1, r2, lsl #8
+  strh r1, [r0, #2]
+  lsr r1, r10, #17
+  ldr r2, =0xfff
+  and r1, r1, r2
+  strh r1, [r0, #4]
+  and r1, r10, #0x7f
+  add r1, r1, #0xc0
+  strh r1, [r0, #6]
+  add r0, r0, #8
+  add r3, r3, #1
+  cmp r3, #128
+  bne 4b
+  b frame
+.ltorg
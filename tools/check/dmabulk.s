@@ -0,0 +1,80 @@
+@ immediate dma3 transfers that the bulk path has to run exactly like the
+@ unit by unit one: overlapping copies both ways, decrementing and fixed
+@ addresses, a rom source set to decrement, ends that wrap around ewram
+@ and the mirrored top of vram, a bios source, and a long copy that hblank
+@ dma0 interrupts. a timer overflowing every 256 cycles keeps the room
+@ before the next event short, and the rom waitstates change every frame
+.include "common.inc"
+.macro dma3 sad, dad, ct, cnth
+  ldr r1, =\sad
+  str r1, [r0, #0xd4]
+  ldr r1, =\dad
+  str r1, [r0, #0xd8]
+  ldr r1, =\ct
+  strh r1, [r0, #0xdc]
+  ldr r1, =\cnth
+  strh r1, [r0, #0xde]
+  nop
+  nop
+.endm
+start:
+  ldr r10, =0x3C6EF372
+  mov r0, #0x02000000
+  ldr r1, =0x10000
+  fill_rand
+  mov r0, #0x04000000
+  ldr r1, =0x1100
+  strh r1, [r0]
+  add r2, r0, #0x100
+  ldr r1, =0xff00
+  strh r1, [r2]
+  mov r1, #0x80
+  strh r1, [r2, #2]
+  mov r9, #0
+frame:
+  wait_vcount 160
+  add r9, r9, #1
+  mov r0, #0x02000000
+  mov r1, #0x40
+  fill_rand
+  mov r0, #0x04000000
+  @ sram, ws0 and ws1 waitstates and the prefetcher follow the frame count
+  and r1, r9, #0xff
+  orr r1, r1, r9, lsl #8
+  ldr r2, =0x5fff
+  and r1, r1, r2
+  add r2, r0, #0x200
+  strh r1, [r2, #4]
+  dma3 0x02000000, 0x03000000, 0x0400, 0x8400
+  dma3 0x02001000, 0x02001008, 0x0800, 0x8400
+  dma3 0x02004008, 0x02004000, 0x0800, 0x8000
+  dma3 0x02008ffe, 0x0200affe, 0x0300, 0x80a0
+  dma3 0x02000040, 0x03001ffc, 0x0200, 0x8520
+  dma3 rom_data, 0x0200c000, 0x0400, 0x8480
+  dma3 0x02000000, 0x0203ff00, 0x0100, 0x8400
+  dma3 0x03000000, 0x06017f00, 0x0200, 0x8000
+  dma3 0x02002000, 0x07000000, 0x0100, 0x8400
+  dma3 0x02003000, 0x05000000, 0x0200, 0x8460
+  dma3 0x00000100, 0x02010000, 0x0010, 0x8400
+  @ a copy long enough to span many lines with hblank dma0 in between
+  wait_vcount 40
+  mov r0, #0x04000000
+  mov r1, #0
+  strh r1, [r0, #0xba]
+  ldr r1, =0x02000000
+  str r1, [r0, #0xb0]
+  ldr r1, =0x04000010
+  str r1, [r0, #0xb4]
+  mov r1, #1
+  strh r1, [r0, #0xb8]
+  ldr r1, =0xa240
+  strh r1, [r0, #0xba]
+  dma3 0x02020000, 0x02030000, 0x3000, 0x8400
+  b frame
+.ltorg
+
+.align 12
+rom_data:
+.rept 0x400
+.word 0x9E3779B9, 0x7F4A7C15, 0xF39CC060, 0x5CEDC834
+.endr
@@ -0,0 +1,129 @@
+@ apu fuzz: random psg channel and mixer registers every frame with the
+@ channels restarted every 4th, new wave ram and timer1 reload every 8th,
+@ the fifo mixer reset every 16th and the master enable turned off and on
+@ every 32nd, while timer driven sound dma and direct writes feed both
+@ fifos. the sound and timer registers are logged to ewram every frame
+.include "common.inc"
+start:
+  ldr r7, =0x04000100
+  ldr r10, =0x1B873593
+  mov r0, #0x02000000
+  mov r1, #0x1000
+  fill_rand
+  mov r0, #0x04000000
+  mov r1, #0x80
+  strh r1, [r0, #0x84]
+  ldr r1, =0xFF77
+  strh r1, [r0, #0x80]
+  ldr r1, =0xFB0E
+  strh r1, [r0, #0x82]
+  ldr r1, =0x02000000
+  str r1, [r0, #0xbc]
+  ldr r1, =0x040000A0
+  str r1, [r0, #0xc0]
+  ldr r1, =0xB640
+  strh r1, [r0, #0xc6]
+  ldr r1, =0x02002000
+  str r1, [r0, #0xc8]
+  ldr r1, =0x040000A4
+  str r1, [r0, #0xcc]
+  ldr r1, =0xB640
+  strh r1, [r0, #0xd2]
+  ldr r1, =0xFE00
+  strh r1, [r7, #0x00]
+  mov r1, #0x80
+  strh r1, [r7, #0x02]
+  ldr r1, =0xFD44
+  strh r1, [r7, #0x04]
+  mov r1, #0x80
+  strh r1, [r7, #0x06]
+  mov r1, #0
+  strh r1, [r7, #0x08]
+  mov r1, #0x80
+  strh r1, [r7, #0x0a]
+  mov r1, #0x84
+  strh r1, [r7, #0x0e]
+  mov r9, #0
+frame:
+  wait_vcount 160
+  add r9, r9, #1
+  mov r0, #0x04000000
+  and r2, r9, #0xff
+  ldr r3, =0x02010000
+  add r3, r3, r2, lsl #4
+  ldrh r1, [r0, #0x84]
+  strh r1, [r3, #0]
+  ldrh r1, [r7, #0x00]
+  strh r1, [r3, #2]
+  ldrh r1, [r7, #0x04]
+  strh r1, [r3, #4]
+  ldrh r1, [r7, #0x08]
+  strh r1, [r3, #6]
+  ldrh r1, [r7, #0x0c]
+  strh r1, [r3, #8]
+  ldrh r1, [r0, #0x90]
+  strh r1, [r3, #10]
+  tst r9, #3
+  moveq r4, #0x8000
+  movne r4, #0
+  rnd
+  strh r10, [r0, #0x60]
+  rnd
+  strh r10, [r0, #0x62]
+  rnd
+  bic r1, r10, #0x8000
+  orr r1, r1, r4
+  strh r1, [r0, #0x64]
+  rnd
+  strh r10, [r0, #0x68]
+  rnd
+  bic r1, r10, #0x8000
+  orr r1, r1, r4
+  strh r1, [r0, #0x6c]
+  rnd
+  strh r10, [r0, #0x70]
+  rnd
+  strh r10, [r0, #0x72]
+  rnd
+  bic r1, r10, #0x8000
+  orr r1, r1, r4
+  strh r1, [r0, #0x74]
+  rnd
+  strh r10, [r0, #0x78]
+  rnd
+  bic r1, r10, #0x8000
+  orr r1, r1, r4
+  strh r1, [r0, #0x7c]
+  rnd
+  strh r10, [r0, #0x80]
+  tst r9, #7
+  bne 4f
+  rnd
+  str r10, [r0, #0x90]
+  rnd
+  str r10, [r0, #0x94]
+  rnd
+  str r10, [r0, #0x98]
+  rnd
+  str r10, [r0, #0x9c]
+  rnd
+  orr r1, r10, #0xfc00
+  strh r1, [r7, #0x04]
+4:
+  tst r9, #15
+  ldreq r1, =0xFB0E
+  strheq r1, [r0, #0x82]
+  and r1, r9, #31
+  cmp r1, #5
+  moveq r1, #0
+  strheq r1, [r0, #0x84]
+  and r1, r9, #31
+  cmp r1, #6
+  moveq r1, #0x80
+  strheq r1, [r0, #0x84]
+  rnd
+  str r10, [r0, #0xa0]
+  rnd
+  str r10, [r0, #0xa4]
+  b frame
+.ltorg
@@ -0,0 +1,122 @@
+@ dma fuzz: dma3 copies between every kind of memory with incrementing,
+@ decrementing and fixed addresses and a zero count, plus a random length
+@ copy from rom and a dma0 one, each timed on timer2 into iwram. timer0
+@ overflows fast on odd frames, hblank dma0 scrolls bg0 on even ones and
+@ vblank dma1 refills oam
+.include "common.inc"
+.macro dma3 sad, dad, ct, cnth
+  ldr r1, =\sad
+  str r1, [r0, #0xd4]
+  ldr r1, =\dad
+  str r1, [r0, #0xd8]
+  ldr r1, =\ct
+  strh r1, [r0, #0xdc]
+  ldrh r5, [r7, #0x08]
+  ldr r1, =\cnth
+  strh r1, [r0, #0xde]
+  nop
+  ldrh r6, [r7, #0x08]
+  sub r6, r6, r5
+  strh r6, [r8], #2
+.endm
+start:
+  ldr r7, =0x04000100
+  ldr r10, =0x68E31DA4
+  mov r0, #0x02000000
+  mov r1, #0x1000
+  fill_rand
+  mov r0, #0x03000000
+  mov r1, #0x400
+  fill_rand
+  mov r0, #0x04000000
+  mov r1, #0
+  strh r1, [r7, #0x08]
+  mov r1, #0x80
+  strh r1, [r7, #0x0a]
+  mov r1, #0x84
+  strh r1, [r7, #0x0e]
+  mov r9, #0
+frame:
+  wait_vcount 160
+  add r9, r9, #1
+  mov r0, #0x04000000
+  ldr r8, =0x03006000
+  and r1, r9, #0x3f
+  add r8, r8, r1, lsl #6
+  @ timer0 fast overflows on odd frames
+  ldr r1, =0xFF00
+  strh r1, [r7, #0x00]
+  and r1, r9, #1
+  lsl r1, r1, #7
+  strh r1, [r7, #0x02]
+  dma3 0x08000000, 0x02020000, 256, 0x8400
+  dma3 0x02000000, 0x06004000, 1024, 0x8000
+  dma3 0x03000000, 0x07000000, 256, 0x8400
+  dma3 0x02000100, 0x05000000, 128, 0x8500
+  dma3 0x06004000, 0x02030100, 64, 0x8420
+  dma3 0x08000100, 0x03001000, 300, 0x8000
+  dma3 0x02000000, 0x02038000, 0, 0x8000
+  dma3 0x02000004, 0x0203C002, 33, 0x8480
+  dma3 0x06010000, 0x06014000, 500, 0x8400
+  dma3 0x05000000, 0x02030000, 100, 0x8000
+  @ dma0 IWRAM -> EWRAM
+  ldr r1, =0x03000200
+  str r1, [r0, #0xb0]
+  ldr r1, =0x02024000
+  str r1, [r0, #0xb4]
+  mov r1, #100
+  strh r1, [r0, #0xb8]
+  ldrh r5, [r7, #0x08]
+  ldr r1, =0x8400
+  strh r1, [r0, #0xba]
+  nop
+  ldrh r6, [r7, #0x08]
+  sub r6, r6, r5
+  strh r6, [r8], #2
+  @ random count copy ROM -> EWRAM
+  rnd
+  ldr r1, =0x3ff
+  and r2, r10, r1
+  add r2, r2, #1
+  ldr r1, =0x08000200
+  str r1, [r0, #0xd4]
+  ldr r1, =0x02028000
+  str r1, [r0, #0xd8]
+  strh r2, [r0, #0xdc]
+  ldrh r5, [r7, #0x08]
+  ldr r1, =0x8000
+  strh r1, [r0, #0xde]
+  nop
+  ldrh r6, [r7, #0x08]
+  sub r6, r6, r5
+  strh r6, [r8], #2
+  @ hblank dma0 -> BG0HOFS on even frames, vblank dma1 -> OAM
+  mov r1, #0
+  strh r1, [r0, #0xba]
+  tst r9, #1
+  bne 5f
+  ldr r1, =0x02000000
+  str r1, [r0, #0xb0]
+  ldr r1, =0x04000010
+  str r1, [r0, #0xb4]
+  mov r1, #1
+  strh r1, [r0, #0xb8]
+  ldr r1, =0xA660
+  strh r1, [r0, #0xba]
+5:
+  ldr r1, =0x02001000
+  str r1, [r0, #0xbc]
+  ldr r1, =0x07000100
+  str r1, [r0, #0xc0]
+  mov r1, #64
+  strh r1, [r0, #0xc4]
+  ldr r1, =0x9400
+  strh r1, [r0, #0xc6]
+  ldr r1, =0x0100
+  strh r1, [r0, #0]
+  b frame
+.ltorg
+.org 0x8000
+.rept 0x2000
+.word 0x9E3779B9
+.endr
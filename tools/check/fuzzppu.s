@@ -0,0 +1,172 @@
+@ ppu fuzz: random tiles, maps, palettes and oam, and every frame random
+@ display registers from DISPCNT through BLDY in any mode but the invalid
+@ ones, with identity matrices every 4th frame and plain frames without
+@ windows or effects every 8th. hblank dma scrolls bg0 on odd frames and
+@ changes the backdrop every 3rd, and line 80 gets new registers, colors,
+@ sprites and tiles halfway down
+.include "common.inc"
+start:
+  ldr r10, =0x2545F491
+  mov r0, #0x06000000
+  ldr r1, =0x6000
+  fill_rand
+  @ zero every 4th 32-byte block so there are fully transparent rows
+  mov r0, #0x06000000
+  mov r1, #0xC00
+  mov r2, #0
+4: tst r1, #3
+  bne 5f
+  str r2, [r0, #0]
+  str r2, [r0, #4]
+  str r2, [r0, #8]
+  str r2, [r0, #12]
+  str r2, [r0, #16]
+  str r2, [r0, #20]
+  str r2, [r0, #24]
+  str r2, [r0, #28]
+5: add r0, r0, #32
+  subs r1, r1, #1
+  bne 4b
+  mov r0, #0x05000000
+  mov r1, #0x100
+  fill_rand
+  mov r0, #0x07000000
+  mov r1, #0x100
+  fill_rand
+  mov r0, #0x02000000
+  mov r1, #0x400
+  fill_rand
+  mov r9, #0
+frame:
+  wait_vcount 160
+  add r9, r9, #1
+  mov r0, #0x04000000
+  rnd
+  bic r1, r10, #0x88
+  and r2, r1, #7
+  cmp r2, #6
+  bichs r1, r1, #4
+  strh r1, [r0]
+  mov r3, #8
+6: rnd
+  strh r10, [r0, r3]
+  add r3, r3, #2
+  cmp r3, #0x56
+  bne 6b
+  @ identity affine on every 4th frame
+  tst r9, #3
+  bne 7f
+  mov r1, #0x100
+  mov r2, #0
+  strh r1, [r0, #0x20]
+  strh r2, [r0, #0x22]
+  strh r2, [r0, #0x24]
+  strh r1, [r0, #0x26]
+  strh r1, [r0, #0x30]
+  strh r2, [r0, #0x32]
+  strh r2, [r0, #0x34]
+  strh r1, [r0, #0x36]
+  rnd
+  and r1, r10, #0xff00
+  str r1, [r0, #0x28]
+  rnd
+  and r1, r10, #0x3f00
+  str r1, [r0, #0x2c]
+  str r2, [r0, #0x38]
+  str r2, [r0, #0x3c]
+7:
+  @ plain frames without windows/effects every 8th frame
+  and r1, r9, #7
+  cmp r1, #5
+  bne 8f
+  ldrh r1, [r0]
+  bic r1, r1, #0xe000
+  strh r1, [r0]
+  mov r1, #0
+  strh r1, [r0, #0x50]
+  strh r1, [r0, #0x4c]
+8:
+  mov r4, r0
+  mov r0, #0x05000000
+  mov r1, #0x100
+  fill_rand
+  tst r9, #1
+  bne 9f
+  mov r0, #0x07000000
+  mov r1, #0x100
+  fill_rand
+9:
+  rnd
+  ldr r1, =0x1f800
+  and r1, r10, r1
+  cmp r1, #0x18000
+  subhs r1, r1, #0x8000
+  add r0, r1, #0x06000000
+  mov r1, #0x200
+  fill_rand
+  mov r0, r4
+  @ hblank dma0 -> BG0HOFS/VOFS on odd frames
+  mov r1, #0
+  strh r1, [r0, #0xba]
+  strh r1, [r0, #0xc6]
+  tst r9, #1
+  beq 10f
+  rnd
+  and r1, r10, #0x1f0
+  add r1, r1, #0x02000000
+  str r1, [r0, #0xb0]
+  ldr r1, =0x04000010
+  str r1, [r0, #0xb4]
+  mov r1, #1
+  strh r1, [r0, #0xb8]
+  ldr r1, =0xA660
+  strh r1, [r0, #0xba]
+10:
+  @ hblank dma1 -> backdrop every 3rd frame
+  mov r1, r9
+11: subs r1, r1, #3
+  bhi 11b
+  bne 12f
+  ldr r1, =0x02000400
+  str r1, [r0, #0xbc]
+  ldr r1, =0x05000000
+  str r1, [r0, #0xc0]
+  mov r1, #1
+  strh r1, [r0, #0xc4]
+  ldr r1, =0xA240
+  strh r1, [r0, #0xc6]
+12:
+  wait_vcount 80
+  mov r0, #0x04000000
+  rnd
+  bic r1, r10, #0x88
+  and r2, r1, #7
+  cmp r2, #6
+  bichs r1, r1, #4
+  strh r1, [r0]
+  rnd
+  strh r10, [r0, #0x10]
+  rnd
+  strh r10, [r0, #0x50]
+  rnd
+  str r10, [r0, #0x28]
+  rnd
+  strh r10, [r0, #0x40]
+  rnd
+  strh r10, [r0, #0x4c]
+  mov r0, #0x05000000
+  mov r1, #16
+  fill_rand
+  rnd
+  and r1, r10, #0x3c0
+  add r0, r1, #0x07000000
+  mov r1, #16
+  fill_rand
+  rnd
+  ldr r1, =0xff00
+  and r1, r10, r1
+  add r0, r1, #0x06000000
+  mov r1, #64
+  fill_rand
+  b frame
+.ltorg
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "apu_thread.h"
+#include "arm_isa.h"
+#include "emulator.h"
+#include "gba.h"
+#include "ppu_replay.h"
+#include "ppu_thread.h"
+#include "thumb_isa.h"
+
+// runs a rom for a fixed number of frames as fast as it goes and prints
+// the speed along with hashes of the last frame and of the machine state,
+// so runs can be compared across builds with no display around. saves are
+// neither read nor written, which keeps every run of a rom the same. like
+// the frontend it loads bios.bin and skips the boot unless told otherwise
+
+static const char usage[] = "agbemu-headless [options] <romfile>\n"
+                            "-b <biosfile> -- specify bios file path (default bios.bin)\n"
+                            "-B -- boot through the bios instead of skipping to the rom\n"
+                            "-z -- run on a zeroed bios, for roms that never call into it\n"
+                            "-c <frames> -- frames to run (default 600)\n"
+                            "-i <movie> -- play back an input movie\n"
+                            "-o <file> -- write the last frame as a ppm image\n"
+                            "-p <file> -- capture the ppu input of the first frames for ppubench\n"
+                            "-k <n|auto> -- frames to skip per frame drawn, or skip while running late\n"
+                            "-n -- don't draw video\n"
+                            "-s -- disable sound synthesis\n"
+                            "-a -- synthesize sound on a separate thread\n"
+                            "-t -- render on a separate thread\n";
+
+// an input movie is a text file of "<frame> <keys>" lines, keys being the
+// pressed buttons as a hex mask in keyinput bit order. each line holds
+// from its frame until the next one
+typedef struct {
+    int frame;
+    hword keys;
+} MovieEntry;
+
+MovieEntry* movie;
+int movie_len;
+
+char* moviefile;
+char* outfile;
+int frames = 600;
+bool blank_bios;
+
+static bool load_movie(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    if (!fp) return false;
+    int cap = 0;
+    int frame;
+    unsigned keys;
+    while (fscanf(fp, "%d %x", &frame, &keys) == 2) {
+        if (movie_len == cap) {
+            cap = cap ? 2 * cap : 64;
+            movie = realloc(movie, cap * sizeof *movie);
+        }
+        movie[movie_len++] = (MovieEntry){frame, keys & 0x3ff};
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool read_headless_args(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            agbemu.romfile = argv[i];
+            continue;
+        }
+        // every option with a value takes the next argument
+        char* val = i + 1 < argc ? argv[i + 1] : NULL;
+        switch (argv[i][1]) {
+            case 'b':
+                if (!val) return false;
+                agbemu.biosfile = val;
+                i++;
+                break;
+            case 'B':
+                agbemu.bootbios = true;
+                break;
+            case 'z':
+                blank_bios = true;
+                break;
+            case 'c':
+                frames = val ? atoi(val) : 0;
+                i++;
+                break;
+            case 'i':
+                moviefile = val;
+                i++;
+                break;
+            case 'o':
+                outfile = val;
+                i++;
+                break;
+            case 'p':
+                agbemu.capturefile = val;
+                i++;
+                break;
+            case 'k':
+                agbemu.frameskip = !val ? 0 : strcmp(val, "auto") ? atoi(val) : FRAMESKIP_AUTO;
+                i++;
+                break;
+            case 'n':
+                agbemu.video_off = true;
+                break;
+            case 's':
+                agbemu.silent = true;
+                break;
+            case 'a':
+                agbemu.audio_thread = true;
+                break;
+            case 't':
+                agbemu.render_thread = true;
+                break;
+            default:
+                printf("Invalid flag\n");
+                return false;
+        }
+    }
+    return agbemu.romfile && frames > 0;
+}
+
+static double secs_since(struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void write_ppm(GBA* gba, const char* filename) {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) {
+        printf("Could not open %s\n", filename);
+        return;
+    }
+    fprintf(fp, "P6\n%d %d\n255\n", GBA_SCREEN_W, GBA_SCREEN_H);
+    for (int y = 0; y < GBA_SCREEN_H; y++) {
+        for (int x = 0; x < GBA_SCREEN_W; x++) {
+            word c = gba->ppu_cache.screen[y][x];
+            byte rgb[3] = {c >> 16, c >> 8, c};
+            fwrite(rgb, 1, 3, fp);
+        }
+    }
+    fclose(fp);
+}
+
+int main(int argc, char** argv) {
+    if (!read_headless_args(argc, argv)) {
+        printf(usage);
+        return -1;
+    }
+    if (moviefile && !load_movie(moviefile)) {
+        printf("Invalid movie file\n");
+        return -1;
+    }
+
+    agbemu.gba = malloc(sizeof *agbemu.gba);
+    agbemu.cart = create_cartridge(agbemu.romfile);
+    if (!agbemu.cart) {
+        printf("Invalid rom file\n");
+        return -1;
+    }
+    if (agbemu.cart->sav_size) memset(agbemu.cart->sram, 0xff, agbemu.cart->sav_size);
+
+    if (!agbemu.biosfile) agbemu.biosfile = "bios.bin";
+    agbemu.bios = blank_bios ? calloc(BIOS_SIZE, 1) : load_bios(agbemu.biosfile);
+    if (!agbemu.bios) {
+        printf("Invalid or missing bios file.\n");
+        return -1;
+    }
+
+    // lines are only captured where they are drawn in order
+    if (agbemu.capturefile) agbemu.render_thread = false;
+
+    arm_generate_lookup();
+    thumb_generate_lookup();
+    init_gba(agbemu.gba, agbemu.cart, agbemu.bios, agbemu.bootbios);
+    init_audio();
+    init_video();
+
+    if (agbemu.capturefile && !replay_capture_start(agbemu.capturefile, CAPTURE_FRAMES)) {
+        printf("Could not open capture file\n");
+        return -1;
+    }
+
+    GBA* gba = agbemu.gba;
+    static float samples[SAMPLE_BUF_LEN];
+    int next_input = 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int f = 0; f < frames; f++) {
+        while (next_input < movie_len && movie[next_input].frame <= f) {
+            gba->io.keyinput.keys = ~movie[next_input++].keys;
+        }
+        update_keypad_irq(gba);
+
+        // a stopped gba sits the frame out until a key wakes it. auto
+        // frameskip counts as late when behind 60 frames per second
+        gba->ppu.skip_frame = skip_next_frame(secs_since(&start) > f / 60.0);
+        while (!gba->stop && !gba->ppu.frame_complete) {
+            gba_step(gba);
+            gba->apu.samples_full = false;
+        }
+        gba->ppu.frame_complete = false;
+
+        if (gba->apu.deferred) {
+            apu_thread_sync(gba);
+            while (apu_thread_samples(samples)) {
+            }
+        }
+    }
+
+    double secs = secs_since(&start);
+
+    printf("%d frames in %.3f s: %.2f fps, %.2fM cycles/s\n", frames, secs, frames / secs,
+           gba->sched.now / secs / 1e6);
+    printf("screen %016lx\n", gba_hash_screen(gba));
+    printf("state %016lx\n", gba_hash_state(gba));
+
+    if (outfile) write_ppm(gba, outfile);
+
+    apu_thread_stop(gba);
+    ppu_thread_stop(gba);
+    replay_capture_stop();
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gba.h"
+#include "ppu.h"
+#include "ppu_replay.h"
+
+// replays a capture made with agbemu -p, checking the first pass against
+// the captured pixels and timing every line after that. lines are grouped
+// by what selects the renderer variants: bg mode, text depth, blend
+// effect and whether windows or sprites are on. with -s it instead draws
+// every line in each blend effect with the windows off and on, and checks
+// the vector compositor against the scalar one it has to match. -s with
+// no capture makes up the layers, windows and blend registers itself
+
+static const char usage[] = "ppubench <capture> [passes]\n"
+                            "ppubench -s [capture]\n";
+
+#define GROUPS (8 * 4 * 4 * 2 * 2)
+
+typedef struct {
+    dword lines;
+    dword ns;
+} Group;
+
+Group groups[GROUPS];
+
+static byte* read_file(const char* filename, long* len) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    byte* data = malloc(*len);
+    if (fread(data, 1, *len, fp) != *len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+// 0 for no text bgs, 1 for only 4bpp, 2 for only 8bpp, 3 for both
+static int text_depths(IO* io) {
+    int n = io->dispcnt.bg_mode == 0 ? 4 : io->dispcnt.bg_mode == 1 ? 2 : 0;
+    int depths = 0;
+    for (int i = 0; i < n; i++) {
+        if (io->dispcnt.bg_enable & (1 << i)) depths |= 1 << io->bgcnt[i].palmode;
+    }
+    return depths;
+}
+
+static int group_of(IO* io) {
+    int g = io->dispcnt.bg_mode;
+    g = g * 4 + text_depths(io);
+    g = g * 4 + io->bldcnt.effect;
+    g = g * 2 + (io->dispcnt.win_enable || io->dispcnt.winobj_enable);
+    g = g * 2 + io->dispcnt.obj_enable;
+    return g;
+}
+
+static dword now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// the line composed by compose_lines and then by compose_lines_scalar from
+// the same layers, returns whether they differ
+static bool compose_differs(GBA* gba, int row_size) {
+    static byte row[GBA_SCREEN_W * 4];
+    ppu_forget_lines(&gba->ppu);
+    draw_scanline(&gba->ppu);
+    memcpy(row, gba->ppu_cache.screen[gba->ppu.ly], row_size);
+    compose_lines_scalar(&gba->ppu);
+    return memcmp(row, gba->ppu_cache.screen[gba->ppu.ly], row_size);
+}
+
+// runs the line under every blend effect with the windows off and on,
+// returns in how many of them the compositors differ
+static int compare_compositors(GBA* gba, ReplayLine* line, int row_size) {
+    int mismatches = 0;
+    for (int effect = EFF_NONE; effect <= EFF_BDEC; effect++) {
+        for (int win = 0; win < 2; win++) {
+            memcpy(gba->io.b, line->io, sizeof line->io);
+            memcpy(gba->ppu.objdotattrs, line->objdotattrs, sizeof line->objdotattrs);
+            gba->io.bldcnt.effect = effect;
+            gba->io.dispcnt.win_enable = win ? 3 : 0;
+            gba->io.dispcnt.winobj_enable = win && gba->io.dispcnt.obj_enable;
+            if (compose_differs(gba, row_size)) mismatches++;
+        }
+    }
+    return mismatches;
+}
+
+#define RANDOM_LINES 4000
+
+static word rand_state = 0x2545f491;
+
+static word next_rand() {
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+// a line as the renderers could have left it: every layer has about a
+// third of its dots transparent, the obj dots get random priorities and
+// on some lines semitransparency, and the windows, priorities and blend
+// registers are random with out of range coefficients included
+static void random_line(GBA* gba) {
+    PPU* ppu = &gba->ppu;
+    IO* io = &gba->io;
+    memset(io->b, 0, sizeof io->b);
+    ppu->ly = next_rand() % GBA_SCREEN_H;
+
+    for (int l = 0; l < LBD; l++) {
+        for (int x = 0; x < GBA_SCREEN_W; x++) {
+            word r = next_rand();
+            ppu->layerlines[l][x] = (r & 0x7fff) | (r % 3 == 0) << 15;
+        }
+    }
+    hword backdrop = next_rand() & 0x7fff;
+    for (int x = 0; x < GBA_SCREEN_W; x++) ppu->layerlines[LBD][x] = backdrop;
+
+    bool semitrans = next_rand() % 4 == 0;
+    ppu->obj_semitrans = false;
+    for (int x = 0; x < GBA_SCREEN_W; x++) {
+        word r = next_rand();
+        ppu->objdotattrs[x].priority = r & 3;
+        ppu->objdotattrs[x].semitrans = semitrans && (r & 4);
+        ppu->objdotattrs[x].mosaic = 0;
+        ppu->obj_semitrans |= ppu->objdotattrs[x].semitrans;
+    }
+    for (int k = 0; k < WIN_WORDS; k++) {
+        ppu->objwin[k] = (dword) next_rand() << 32 | next_rand();
+    }
+
+    for (int i = 0; i < 4; i++) {
+        ppu->draw_bg[i] = next_rand() & 1;
+        io->bgcnt[i].priority = next_rand() & 3;
+    }
+    ppu->draw_obj = next_rand() & 1;
+    io->dispcnt.obj_enable = ppu->draw_obj;
+
+    for (int i = 0; i < 2; i++) {
+        io->winh[i].x1 = next_rand();
+        io->winh[i].x2 = next_rand();
+        ppu->in_win[i] = next_rand() & 1;
+    }
+    io->winin = next_rand();
+    io->winout = next_rand();
+
+    io->bldcnt.target1 = next_rand();
+    io->bldcnt.target2 = next_rand();
+    io->bldalpha.eva = next_rand();
+    io->bldalpha.evb = next_rand();
+    io->bldy.evy = next_rand();
+}
+
+// the made up lines in both host formats, under every blend effect with
+// the windows off and on, returns in how many the compositors differ
+static int compare_random(GBA* gba) {
+    int mismatches = 0;
+    for (int fmt = PIXFMT_XRGB8888; fmt <= PIXFMT_RGB565; fmt++) {
+        ppu_set_pixfmt(fmt, false);
+        int row_size = GBA_SCREEN_W * (fmt == PIXFMT_RGB565 ? 2 : 4);
+        static byte row[GBA_SCREEN_W * 4];
+        for (int i = 0; i < RANDOM_LINES; i++) {
+            random_line(gba);
+            for (int effect = EFF_NONE; effect <= EFF_BDEC; effect++) {
+                for (int win = 0; win < 2; win++) {
+                    gba->io.bldcnt.effect = effect;
+                    gba->io.dispcnt.win_enable = win ? 3 : 0;
+                    gba->io.dispcnt.winobj_enable = win;
+                    render_windows(&gba->ppu);
+                    compose_lines(&gba->ppu);
+                    memcpy(row, gba->ppu_cache.screen[gba->ppu.ly], row_size);
+                    compose_lines_scalar(&gba->ppu);
+                    if (memcmp(row, gba->ppu_cache.screen[gba->ppu.ly], row_size)) mismatches++;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+// runs every record once, returns the number of lines that differ from
+// the capture when checking, or between the compositors when comparing
+static int replay(GBA* gba, byte* data, long len, bool check, bool compare) {
+    int mismatches = 0;
+    int row_size = GBA_SCREEN_W * (host_pixfmt == PIXFMT_RGB565 ? 2 : 4);
+    long pos = sizeof(ReplayHeader);
+    while (pos < len) {
+        if (data[pos++] == REPLAY_MEM) {
+            int gen = data[pos++];
+            word size;
+            byte* mem = replay_region(gba, gen, &size);
+            memcpy(mem, &data[pos], size);
+            pos += size;
+            gba->ppu.mem_gen[gen]++;
+            ppu_invalidate_caches(gba);
+            continue;
+        }
+
+        ReplayLine* line = (ReplayLine*) &data[pos];
+        pos += sizeof *line;
+
+        memcpy(gba->io.b, line->io, sizeof line->io);
+        gba->ppu.ly = line->ly;
+        ppu_load_latch(&gba->ppu, &line->latch);
+        memcpy(gba->ppu.objdotattrs, line->objdotattrs, sizeof line->objdotattrs);
+        ppu_forget_lines(&gba->ppu);
+
+        if (compare) {
+            mismatches += compare_compositors(gba, line, row_size);
+            continue;
+        }
+
+        dword start = now_ns();
+        draw_scanline(&gba->ppu);
+        dword end = now_ns();
+
+        if (check) {
+            if (memcmp(gba->ppu_cache.screen[line->ly], line->out, row_size)) mismatches++;
+        } else {
+            Group* g = &groups[group_of(&gba->io)];
+            g->lines++;
+            g->ns += end - start;
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char** argv) {
+    bool compare = argc > 1 && !strcmp(argv[1], "-s");
+    if (compare) {
+        argc--;
+        argv++;
+    }
+    if (argc < 2 && !compare) {
+        printf(usage);
+        return -1;
+    }
+
+    if (argc < 2) {
+        GBA* gba = calloc(1, sizeof *gba);
+        gba_set_ptrs(gba, NULL, NULL);
+        int mismatches = compare_random(gba);
+        printf("%d of %d made up line variants differ between the compositors\n", mismatches,
+               2 * RANDOM_LINES * 8);
+        free(gba);
+        return mismatches ? 1 : 0;
+    }
+    int passes = argc > 2 ? atoi(argv[2]) : 1000;
+
+    long len;
+    byte* data = read_file(argv[1], &len);
+    ReplayHeader* hdr = (ReplayHeader*) data;
+    if (!data || len < sizeof *hdr || memcmp(hdr->magic, REPLAY_MAGIC, sizeof hdr->magic)) {
+        printf("Invalid capture file\n");
+        return -1;
+    }
+    ppu_set_pixfmt(hdr->pixfmt, hdr->filter);
+
+    GBA* gba = calloc(1, sizeof *gba);
+    gba_set_ptrs(gba, NULL, NULL);
+
+    if (compare) {
+        int mismatches = replay(gba, data, len, false, true);
+        printf("%d line variants differ between the compositors\n", mismatches);
+        free(gba);
+        free(data);
+        return mismatches ? 1 : 0;
+    }
+
+    int mismatches = replay(gba, data, len, true, false);
+    for (int i = 0; i < passes; i++) replay(gba, data, len, false, false);
+
+    static const char* effects[4] = {"none", "alpha", "binc", "bdec"};
+    static const char* depths[4] = {"-", "4bpp", "8bpp", "both"};
+    printf("mode  text  effect  win  obj      lines   ns/line\n");
+    dword lines = 0, ns = 0;
+    for (int g = 0; g < GROUPS; g++) {
+        if (!groups[g].lines) continue;
+        printf("%4d  %4s  %6s  %3d  %3d  %9lu  %8.1f\n", g / 64, depths[g / 16 % 4],
+               effects[g / 4 % 4], g / 2 % 2, g % 2, groups[g].lines,
+               (double) groups[g].ns / groups[g].lines);
+        lines += groups[g].lines;
+        ns += groups[g].ns;
+    }
+    printf("total             %9lu  %8.1f\n", lines, lines ? (double) ns / lines : 0);
+    printf("%d lines differ from the capture\n", mismatches);
+
+    free(gba);
+    free(data);
+    return mismatches ? 1 : 0;
+}
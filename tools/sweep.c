@@ -0,0 +1,394 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arm_isa.h"
+#include "gba.h"
+#include "thumb_isa.h"
+
+// runs every rom in a directory for a fixed number of frames, each in its
+// own process pinned to a core so a crash or a hang only takes that rom
+// down. a rom passes when its final state matches what an expectations
+// file says a pass looks like: the hashes of the last frame and of the
+// machine state, as printed by agbemu-headless, or values in registers or
+// in memory, for test roms that leave their results there. -w records the
+// hashes of a run as expectations, to check later runs against once they
+// were verified. like the frontend it loads bios.bin and skips the boot
+// unless told otherwise
+
+static const char usage[] = "sweep [options] <romdir>\n"
+                            "-b <biosfile> -- specify bios file path (default bios.bin)\n"
+                            "-B -- boot through the bios instead of skipping to the rom\n"
+                            "-z -- run on a zeroed bios, for roms that never call into it\n"
+                            "-c <frames> -- frames to run each rom for (default 600)\n"
+                            "-j <jobs> -- roms run at once (default one per core)\n"
+                            "-t <seconds> -- run time before a rom counts as hung (default 60)\n"
+                            "-e <file> -- check the roms against these expectations\n"
+                            "-w <file> -- write the hashes of this run as expectations\n";
+
+// an expectations file has lines of
+//   <rom file name> screen <hash>
+//   <rom file name> state <hash>
+//   <rom file name> reg <n> <value>
+//   <rom file name> mem <addr> <value>
+// with values in hex, a rom passes when all of its lines hold. a line
+//   frames <n>
+// sets the frames to run in place of -c. lines starting with # are skipped
+typedef enum { EXPECT_NONE, EXPECT_SCREEN, EXPECT_STATE, EXPECT_REG, EXPECT_MEM } ExpectType;
+
+#define EXPECTS_MAX 8
+
+typedef struct {
+    ExpectType type;
+    word where;
+    dword value;
+} Expect;
+
+typedef enum { ST_RAN, ST_PASS, ST_FAIL, ST_HANG, ST_CRASH, ST_ERROR, ST_MAX } Status;
+
+static const char* status_names[ST_MAX] = {"ran", "pass", "fail", "hang", "crash", "error"};
+
+// what a worker sends back over its pipe
+typedef struct {
+    Status status;
+    double secs;
+    dword screen;
+    dword state;
+} Report;
+
+typedef struct {
+    char* name;
+    Expect expect[EXPECTS_MAX];
+    int n_expect;
+    Report report;
+} Rom;
+
+typedef struct {
+    pid_t pid;
+    int rom;
+    int fd;
+} Worker;
+
+#define JOBS_MAX 256
+
+Rom* roms;
+int n_roms;
+
+char* romdir;
+char* biosfile;
+char* expectfile;
+char* writefile;
+int frames = 600;
+int jobs;
+int timeout = 60;
+bool bootbios;
+bool blank_bios;
+
+static bool read_sweep_args(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] != '-') {
+            romdir = argv[i];
+            continue;
+        }
+        switch (argv[i][1]) {
+            case 'B':
+                bootbios = true;
+                continue;
+            case 'z':
+                blank_bios = true;
+                continue;
+        }
+        // the rest take the next argument
+        char* val = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!val) return false;
+        switch (argv[i][1]) {
+            case 'b':
+                biosfile = val;
+                break;
+            case 'c':
+                frames = atoi(val);
+                break;
+            case 'j':
+                jobs = atoi(val);
+                break;
+            case 't':
+                timeout = atoi(val);
+                break;
+            case 'e':
+                expectfile = val;
+                break;
+            case 'w':
+                writefile = val;
+                break;
+            default:
+                printf("Invalid flag\n");
+                return false;
+        }
+        i++;
+    }
+    return romdir && frames > 0 && timeout > 0;
+}
+
+static bool is_rom(const char* name) {
+    const char* ext = strrchr(name, '.');
+    if (!ext) return false;
+    return !strcasecmp(ext, ".gba") || !strcasecmp(ext, ".agb") || !strcasecmp(ext, ".bin");
+}
+
+static int compare_roms(const void* a, const void* b) {
+    return strcmp(((Rom*) a)->name, ((Rom*) b)->name);
+}
+
+static bool find_roms(const char* dirname) {
+    DIR* dir = opendir(dirname);
+    if (!dir) return false;
+    int cap = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir))) {
+        if (!is_rom(ent->d_name)) continue;
+        if (n_roms == cap) {
+            cap = cap ? 2 * cap : 64;
+            roms = realloc(roms, cap * sizeof *roms);
+        }
+        roms[n_roms++] = (Rom){.name = strdup(ent->d_name)};
+    }
+    closedir(dir);
+    qsort(roms, n_roms, sizeof *roms, compare_roms);
+    return true;
+}
+
+static bool load_expectations(const char* filename) {
+    FILE* fp = fopen(filename, "r");
+    if (!fp) return false;
+    char line[512];
+    while (fgets(line, sizeof line, fp)) {
+        char name[256], type[16];
+        int args;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "frames %d", &frames) == 1) continue;
+        if (sscanf(line, "%255s %15s %n", name, type, &args) != 2) continue;
+        Expect e;
+        if (!strcmp(type, "screen") && sscanf(line + args, "%lx", &e.value) == 1) {
+            e.type = EXPECT_SCREEN;
+        } else if (!strcmp(type, "state") && sscanf(line + args, "%lx", &e.value) == 1) {
+            e.type = EXPECT_STATE;
+        } else if (!strcmp(type, "reg") && sscanf(line + args, "%x %lx", &e.where, &e.value) == 2 &&
+                   e.where < 16) {
+            e.type = EXPECT_REG;
+        } else if (!strcmp(type, "mem") && sscanf(line + args, "%x %lx", &e.where, &e.value) == 2) {
+            e.type = EXPECT_MEM;
+        } else continue;
+        for (int i = 0; i < n_roms; i++) {
+            if (strcmp(roms[i].name, name) || roms[i].n_expect == EXPECTS_MAX) continue;
+            roms[i].expect[roms[i].n_expect++] = e;
+        }
+    }
+    fclose(fp);
+    return frames > 0;
+}
+
+static bool expect_holds(GBA* gba, Expect* e, Report* rep) {
+    switch (e->type) {
+        case EXPECT_SCREEN:
+            return rep->screen == e->value;
+        case EXPECT_STATE:
+            return rep->state == e->value;
+        case EXPECT_REG:
+            return gba->cpu.r[e->where] == e->value;
+        case EXPECT_MEM:
+            return bus_readw(gba, e->where) == e->value;
+        default:
+            return true;
+    }
+}
+
+static Status check_expects(GBA* gba, Rom* rom, Report* rep) {
+    if (!rom->n_expect) return ST_RAN;
+    for (int i = 0; i < rom->n_expect; i++) {
+        if (!expect_holds(gba, &rom->expect[i], rep)) return ST_FAIL;
+    }
+    return ST_PASS;
+}
+
+static void pin_to_core(int core) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core, &set);
+    sched_setaffinity(0, sizeof set, &set);
+#endif
+}
+
+// the body of a worker process, a hang is left for the alarm to end
+static Report run_rom(Rom* rom, byte* bios) {
+    Report rep = {ST_ERROR};
+    char path[4096];
+    snprintf(path, sizeof path, "%s/%s", romdir, rom->name);
+    Cartridge* cart = create_cartridge(path);
+    if (!cart) return rep;
+    if (cart->sav_size) memset(cart->sram, 0xff, cart->sav_size);
+
+    GBA* gba = malloc(sizeof *gba);
+    init_gba(gba, cart, bios, bootbios);
+
+    alarm(timeout);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int f = 0; f < frames; f++) {
+        while (!gba->stop && !gba->ppu.frame_complete) {
+            gba_step(gba);
+            gba->apu.samples_full = false;
+        }
+        gba->ppu.frame_complete = false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    alarm(0);
+
+    rep.secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    rep.screen = gba_hash_screen(gba);
+    rep.state = gba_hash_state(gba);
+    rep.status = check_expects(gba, rom, &rep);
+    return rep;
+}
+
+static bool start_worker(Worker* w, int rom, int core, byte* bios) {
+    int fds[2];
+    if (pipe(fds) < 0) return false;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        pin_to_core(core);
+        Report rep = run_rom(&roms[rom], bios);
+        (void) !write(fds[1], &rep, sizeof rep);
+        _exit(0);
+    }
+    close(fds[1]);
+    *w = (Worker){pid, rom, fds[0]};
+    return true;
+}
+
+// a worker that died without reporting hung if the alarm got it and
+// crashed otherwise
+static void finish_worker(Worker* w, int status) {
+    Report* rep = &roms[w->rom].report;
+    if (read(w->fd, rep, sizeof *rep) != sizeof *rep) {
+        *rep = (Report){WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM ? ST_HANG : ST_CRASH};
+    }
+    close(w->fd);
+    w->pid = 0;
+}
+
+static void run_sweep(byte* bios) {
+    static Worker workers[JOBS_MAX];
+    int cores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cores < 1) cores = 1;
+    if (jobs <= 0) jobs = cores;
+    if (jobs > JOBS_MAX) jobs = JOBS_MAX;
+
+    int next = 0, running = 0;
+    while (next < n_roms || running) {
+        for (int i = 0; i < jobs && next < n_roms; i++) {
+            if (workers[i].pid) continue;
+            if (!start_worker(&workers[i], next, i % cores, bios)) {
+                roms[next].report.status = ST_ERROR;
+            } else running++;
+            next++;
+        }
+        if (!running) continue;
+
+        int status;
+        pid_t pid = wait(&status);
+        for (int i = 0; i < jobs; i++) {
+            if (workers[i].pid != pid) continue;
+            finish_worker(&workers[i], status);
+            running--;
+            fprintf(stderr, "\r%d/%d", next - running, n_roms);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+static void print_results() {
+    int counts[ST_MAX] = {0};
+    printf("%-40s %6s %9s  %-16s  %s\n", "rom", "result", "fps", "screen", "state");
+    for (int i = 0; i < n_roms; i++) {
+        Report* rep = &roms[i].report;
+        counts[rep->status]++;
+        printf("%-40s %6s", roms[i].name, status_names[rep->status]);
+        if (rep->status <= ST_FAIL) {
+            printf(" %9.2f  %016lx  %016lx", frames / rep->secs, rep->screen, rep->state);
+        }
+        printf("\n");
+    }
+    printf("%d roms:", n_roms);
+    for (int s = 0; s < ST_MAX; s++) {
+        printf(" %d %s%s", counts[s], status_names[s], s + 1 < ST_MAX ? "," : "\n");
+    }
+}
+
+static void write_expectations(const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) {
+        printf("Could not open %s\n", filename);
+        return;
+    }
+    fprintf(fp, "frames %d\n", frames);
+    for (int i = 0; i < n_roms; i++) {
+        Report* rep = &roms[i].report;
+        if (rep->status > ST_FAIL) continue;
+        fprintf(fp, "%s screen %016lx\n", roms[i].name, rep->screen);
+        fprintf(fp, "%s state %016lx\n", roms[i].name, rep->state);
+    }
+    fclose(fp);
+}
+
+int main(int argc, char** argv) {
+    if (!read_sweep_args(argc, argv)) {
+        printf(usage);
+        return -1;
+    }
+    if (!find_roms(romdir)) {
+        printf("Could not open %s\n", romdir);
+        return -1;
+    }
+    if (expectfile && !load_expectations(expectfile)) {
+        printf("Invalid expectations file\n");
+        return -1;
+    }
+
+    if (!biosfile) biosfile = "bios.bin";
+    byte* bios = blank_bios ? calloc(BIOS_SIZE, 1) : load_bios(biosfile);
+    if (!bios) {
+        printf("Invalid or missing bios file.\n");
+        return -1;
+    }
+
+    arm_generate_lookup();
+    thumb_generate_lookup();
+
+    run_sweep(bios);
+    print_results();
+    if (writefile) write_expectations(writefile);
+
+    bool failed = false;
+    for (int i = 0; i < n_roms; i++) {
+        if (roms[i].report.status > ST_PASS) failed = true;
+    }
+    return failed ? 1 : 0;
+}